@@ -0,0 +1,247 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "aggregate.h"
+
+static trie_key_t
+key_mask(trie_key_t key, int prefixlen) {
+  if (prefixlen <= 0) {
+    key.hi = key.lo = 0;
+  } else if (prefixlen < 64) {
+    key.hi &= ~(UINT64_MAX >> prefixlen);
+    key.lo = 0;
+  } else if (prefixlen < 128) {
+    key.lo &= ~(UINT64_MAX >> (prefixlen - 64));
+  }
+  return key;
+}
+
+/* the key with only bit +i+ (from the most significant) set */
+static trie_key_t
+key_bit(int i) {
+  trie_key_t key = { 0, 0 };
+  if (i < 64) key.hi = (uint64_t) 1 << (63 - i);
+  else key.lo = (uint64_t) 1 << (127 - i);
+  return key;
+}
+
+static int
+key_eql_p(trie_key_t a, trie_key_t b) {
+  return a.hi == b.hi && a.lo == b.lo;
+}
+
+/* by address, then shortest prefix first, so a network sorts before
+ * those it includes */
+static int
+prefix_cmp(const void *x, const void *y) {
+  const prefix_t *a = x, *b = y;
+  if (a->key.hi != b->key.hi) return a->key.hi < b->key.hi ? -1 : 1;
+  if (a->key.lo != b->key.lo) return a->key.lo < b->key.lo ? -1 : 1;
+  return a->prefixlen - b->prefixlen;
+}
+
+static int
+prefix_include_p(const prefix_t *a, const prefix_t *b) {
+  return a->prefixlen <= b->prefixlen && key_eql_p(a->key, key_mask(b->key, a->prefixlen));
+}
+
+/* is +b+ the upper half of the parent of +a+ */
+static int
+prefix_sibling_p(const prefix_t *a, const prefix_t *b) {
+  trie_key_t bit;
+
+  if (a->prefixlen != b->prefixlen || !a->prefixlen) return 0;
+  bit = key_bit(a->prefixlen - 1);
+  return (a->key.hi ^ b->key.hi) == bit.hi && (a->key.lo ^ b->key.lo) == bit.lo &&
+    !(a->key.hi & bit.hi) && !(a->key.lo & bit.lo);
+}
+
+size_t
+aggregate(prefix_t *prefixes, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    prefixes[i].key = key_mask(prefixes[i].key, prefixes[i].prefixlen);
+  }
+  qsort(prefixes, n, sizeof(prefix_t), prefix_cmp);
+  return aggregate_sorted(prefixes, n);
+}
+
+size_t
+aggregate_sorted(prefix_t *prefixes, size_t n) {
+  size_t top = 0;               /* prefixes[0, top) is the result so far */
+
+  /*
+   * The result is sorted and its networks disjoint, so the last of
+   * them is the only one that can include the next network, and a
+   * network's sibling, if present, is right before it.
+   */
+  for (size_t i = 0; i < n; i++) {
+    if (top && prefix_include_p(&prefixes[top - 1], &prefixes[i])) continue;
+
+    prefixes[top++] = prefixes[i];
+    while (top >= 2 && prefix_sibling_p(&prefixes[top - 2], &prefixes[top - 1])) {
+      top--;
+      prefixes[top - 1].prefixlen--;
+    }
+  }
+
+  return top;
+}
+
+void
+prefix_list_init(prefix_list_t *list) {
+  list->prefixes = NULL;
+  list->len = list->cap = 0;
+}
+
+void
+prefix_list_free(prefix_list_t *list) {
+  free(list->prefixes);
+  prefix_list_init(list);
+}
+
+int
+prefix_list_push(prefix_list_t *list, trie_key_t key, int prefixlen) {
+  if (list->len == list->cap) {
+    size_t cap = list->cap ? list->cap * 2 : 64;
+    prefix_t *prefixes;
+    if (cap > SIZE_MAX / sizeof(prefix_t)) return -1;
+    if (!(prefixes = realloc(list->prefixes, cap * sizeof(prefix_t)))) return -1;
+    list->prefixes = prefixes;
+    list->cap = cap;
+  }
+  list->prefixes[list->len].key = key;
+  list->prefixes[list->len].prefixlen = prefixlen;
+  list->len++;
+  return 0;
+}
+
+/* aggregate the prefixes appended to +out+ since it held +start+ */
+static void
+prefix_list_aggregate(prefix_list_t *out, size_t start) {
+  out->len = start + aggregate_sorted(out->prefixes + start, out->len - start);
+}
+
+int
+prefixes_union(const prefix_t *a, size_t na, const prefix_t *b, size_t nb, prefix_list_t *out) {
+  size_t i = 0, j = 0, start = out->len;
+
+  while (i < na || j < nb) {
+    const prefix_t *p = (j == nb || (i < na && prefix_cmp(&a[i], &b[j]) <= 0)) ? &a[i++] : &b[j++];
+    if (prefix_list_push(out, p->key, p->prefixlen)) return -1;
+  }
+  prefix_list_aggregate(out, start);
+  return 0;
+}
+
+int
+prefixes_intersect(const prefix_t *a, size_t na, const prefix_t *b, size_t nb, prefix_list_t *out) {
+  size_t i = 0, j = 0, start = out->len;
+
+  /* two prefixes either are disjoint or one includes the other */
+  while (i < na && j < nb) {
+    if (prefix_include_p(&a[i], &b[j])) {
+      if (prefix_list_push(out, b[j].key, b[j].prefixlen)) return -1;
+      j++;
+    } else if (prefix_include_p(&b[j], &a[i])) {
+      if (prefix_list_push(out, a[i].key, a[i].prefixlen)) return -1;
+      i++;
+    } else if (prefix_cmp(&a[i], &b[j]) < 0) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  prefix_list_aggregate(out, start);
+  return 0;
+}
+
+static int
+key_lt_p(trie_key_t a, trie_key_t b) {
+  return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+/* the last address of +key+/+prefixlen+ among keys of +maxlen+ bits */
+static trie_key_t
+key_last(trie_key_t key, int prefixlen, int maxlen) {
+  trie_key_t ones = { UINT64_MAX, UINT64_MAX };
+  trie_key_t all = key_mask(ones, maxlen), net = key_mask(ones, prefixlen);
+  key.hi |= all.hi & ~net.hi;
+  key.lo |= all.lo & ~net.lo;
+  return key;
+}
+
+/* the address after or before +key+ among keys of +maxlen+ bits */
+static trie_key_t
+key_next(trie_key_t key, int maxlen) {
+  trie_key_t one = key_bit(maxlen - 1);
+  uint64_t lo = key.lo + one.lo;
+  key.hi += one.hi + (lo < key.lo);
+  key.lo = lo;
+  return key;
+}
+
+static trie_key_t
+key_prev(trie_key_t key, int maxlen) {
+  trie_key_t one = key_bit(maxlen - 1);
+  key.hi -= one.hi + (key.lo < one.lo);
+  key.lo -= one.lo;
+  return key;
+}
+
+/* append the fewest prefixes covering the addresses +lo+ to +hi+ */
+static int
+prefix_list_push_range(prefix_list_t *out, trie_key_t lo, trie_key_t hi, int maxlen) {
+  for (;;) {
+    trie_key_t last;
+    int prefixlen = maxlen;
+
+    while (prefixlen > 0 && key_eql_p(key_mask(lo, prefixlen - 1), lo) &&
+           !key_lt_p(hi, key_last(lo, prefixlen - 1, maxlen))) {
+      prefixlen--;
+    }
+    if (prefix_list_push(out, lo, prefixlen)) return -1;
+
+    last = key_last(lo, prefixlen, maxlen);
+    if (key_eql_p(last, hi)) return 0;
+    lo = key_next(last, maxlen);
+  }
+}
+
+int
+prefixes_subtract(const prefix_t *a, size_t na, const prefix_t *b, size_t nb, int maxlen,
+                  prefix_list_t *out) {
+  size_t j = 0, start = out->len;
+
+  for (size_t i = 0; i < na; i++) {
+    trie_key_t lo = a[i].key, hi = key_last(a[i].key, a[i].prefixlen, maxlen);
+    int covered = 0;
+
+    while (j < nb && key_lt_p(key_last(b[j].key, b[j].prefixlen, maxlen), lo)) j++;
+
+    /* every b[j] starting within a[i] includes it or is included in it */
+    for (; j < nb && !key_lt_p(hi, b[j].key); j++) {
+      trie_key_t last;
+
+      if (b[j].prefixlen <= a[i].prefixlen) {
+        covered = 1;            /* b[j] may include a[i + 1] too */
+        break;
+      }
+      if (key_lt_p(lo, b[j].key) &&
+          prefix_list_push_range(out, lo, key_prev(b[j].key, maxlen), maxlen)) {
+        return -1;
+      }
+      last = key_last(b[j].key, b[j].prefixlen, maxlen);
+      if (key_eql_p(last, hi)) {
+        covered = 1;
+        j++;
+        break;
+      }
+      lo = key_next(last, maxlen);
+    }
+
+    if (!covered && prefix_list_push_range(out, lo, hi, maxlen)) return -1;
+  }
+  prefix_list_aggregate(out, start);
+  return 0;
+}
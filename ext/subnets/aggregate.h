@@ -0,0 +1,71 @@
+#ifndef __AGGREGATE_H__
+#define __AGGREGATE_H__
+
+#include <stddef.h>
+
+#include "trie.h"
+
+/**
+ * A network of one address family as a trie key and prefixlen.
+ */
+typedef struct {
+  trie_key_t key;
+  int prefixlen;
+} prefix_t;
+
+/**
+ * Replace the +n+ networks of +prefixes+, all of one address family,
+ * with the fewest networks covering exactly the same addresses:
+ * networks included in others are dropped and sibling pairs are
+ * merged into their parent until none remain.  The result is sorted
+ * by address, with host bits zeroed.  Takes O(n log n) time and no
+ * memory beyond +prefixes+.
+ *
+ * @return the number of networks left at the start of +prefixes+
+ */
+size_t aggregate(prefix_t *prefixes, size_t n);
+
+/**
+ * Like aggregate(), for +prefixes+ already sorted by address and then
+ * prefixlen, with host bits zeroed.  Takes O(n) time.
+ */
+size_t aggregate_sorted(prefix_t *prefixes, size_t n);
+
+/**
+ * A growable array of prefixes.
+ */
+typedef struct {
+  prefix_t *prefixes;
+  size_t len;
+  size_t cap;
+} prefix_list_t;
+
+void prefix_list_init(prefix_list_t *);
+
+void prefix_list_free(prefix_list_t *);
+
+/**
+ * @return zero on success, -1 if the list could not be grown
+ */
+int prefix_list_push(prefix_list_t *, trie_key_t key, int prefixlen);
+
+/*
+ * Set operations on aggregated lists of prefixes of one address
+ * family with keys of +maxlen+ bits, as returned by aggregate().
+ * Each merges the two lists in one pass and appends the aggregated
+ * result to +out+.
+ *
+ * Each returns zero on success, -1 if +out+ could not be grown.
+ */
+
+/** The prefixes covering addresses in +a+ or +b+. */
+int prefixes_union(const prefix_t *a, size_t na, const prefix_t *b, size_t nb, prefix_list_t *out);
+
+/** The prefixes covering addresses in both +a+ and +b+. */
+int prefixes_intersect(const prefix_t *a, size_t na, const prefix_t *b, size_t nb, prefix_list_t *out);
+
+/** The prefixes covering addresses in +a+ but not +b+. */
+int prefixes_subtract(const prefix_t *a, size_t na, const prefix_t *b, size_t nb, int maxlen,
+                      prefix_list_t *out);
+
+#endif                          /* __AGGREGATE_H__ */
@@ -0,0 +1,107 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+
+/* FNV-1a; keys are short, so this costs less than one strict parse */
+static uint32_t
+cache_hash(const char *key, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (uint8_t) key[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static int
+cache_entry_is(const cache_entry_t *e, uint32_t hash, const char *key, size_t len) {
+  return e->stamp && e->hash == hash && e->len == len && !memcmp(e->key, key, len);
+}
+
+int
+cache_init(cache_t *cache, size_t capacity) {
+  size_t cap = CACHE_WAYS;
+
+  cache->entries = NULL;
+  cache->mask = 0;
+  cache->clock = 0;
+  cache->hits = cache->misses = 0;
+
+  if (!capacity) return 0;
+
+  while (cap < capacity) {
+    if (cap > SIZE_MAX / 2 / sizeof(cache_entry_t)) return -1;
+    cap *= 2;
+  }
+
+  /* zeroed entries have a stamp of zero, so are empty */
+  if (!(cache->entries = calloc(cap, sizeof(cache_entry_t)))) return -1;
+  cache->mask = cap - 1;
+  return 0;
+}
+
+void
+cache_free(cache_t *cache) {
+  free(cache->entries);
+  cache->entries = NULL;
+  cache->mask = 0;
+}
+
+size_t
+cache_capacity(const cache_t *cache) {
+  return cache->entries ? cache->mask + 1 : 0;
+}
+
+size_t
+cache_memsize(const cache_t *cache) {
+  return cache_capacity(cache) * sizeof(cache_entry_t);
+}
+
+const cache_entry_t *
+cache_get(cache_t *cache, const char *key, size_t len) {
+  uint32_t hash;
+
+  if (!cache->entries) return NULL;
+
+  if (len <= CACHE_KEY_MAX) {
+    hash = cache_hash(key, len);
+    for (size_t i = 0; i < CACHE_WAYS; i++) {
+      cache_entry_t *e = &cache->entries[(hash + i) & cache->mask];
+      if (cache_entry_is(e, hash, key, len)) {
+        e->stamp = ++cache->clock;
+        cache->hits++;
+        return e;
+      }
+    }
+  }
+
+  cache->misses++;
+  return NULL;
+}
+
+cache_entry_t *
+cache_put(cache_t *cache, const char *key, size_t len) {
+  cache_entry_t *victim = NULL;
+  uint32_t hash;
+
+  if (!cache->entries || len > CACHE_KEY_MAX) return NULL;
+
+  hash = cache_hash(key, len);
+  for (size_t i = 0; i < CACHE_WAYS; i++) {
+    cache_entry_t *e = &cache->entries[(hash + i) & cache->mask];
+    if (cache_entry_is(e, hash, key, len)) {
+      victim = e;
+      break;
+    }
+    if (!victim || e->stamp < victim->stamp) victim = e;
+  }
+
+  victim->stamp = ++cache->clock;
+  victim->hash = hash;
+  victim->len = (uint8_t) len;
+  memcpy(victim->key, key, len);
+  return victim;
+}
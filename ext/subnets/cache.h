@@ -0,0 +1,82 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ipaddr.h"
+
+/* longest key held by a cache; 49 is longest possible ip6 cidr */
+#define CACHE_KEY_MAX 55
+
+/* entries probed per lookup, and the candidates for eviction */
+#define CACHE_WAYS 4
+
+/**
+ * A cached parse of the string +key+, with room for a caller-defined
+ * result such as set membership.
+ */
+typedef struct {
+  uint64_t stamp;               /* time of last use, zero if empty */
+  uint32_t hash;
+  uint8_t len;
+  char key[CACHE_KEY_MAX];
+  addr_t addr;
+  int value;
+} cache_entry_t;
+
+/**
+ * A fixed-size, open-addressed cache of strings.  A key lives in one
+ * of the CACHE_WAYS entries following its hash; when those are all
+ * taken, the least recently used of them is replaced.  Lookups and
+ * insertions never allocate.
+ */
+typedef struct {
+  cache_entry_t *entries;       /* NULL when disabled */
+  size_t mask;                  /* capacity - 1 */
+  uint64_t clock;
+  size_t hits;
+  size_t misses;
+} cache_t;
+
+/**
+ * Initialize a cache of at least +capacity+ entries, rounded up to a
+ * power of two.  A capacity of zero makes a disabled cache, in which
+ * every lookup misses without being counted.
+ *
+ * @return zero on success, -1 if the entries could not be allocated
+ */
+int cache_init(cache_t *, size_t capacity);
+
+/**
+ * Release the memory held by this cache, leaving it disabled.
+ */
+void cache_free(cache_t *);
+
+/**
+ * Number of entries of this cache, zero if disabled.
+ */
+size_t cache_capacity(const cache_t *);
+
+/**
+ * Number of bytes held by this cache.
+ */
+size_t cache_memsize(const cache_t *);
+
+/**
+ * Find the entry for +key+ of +len+ bytes, counting a hit or miss.
+ *
+ * @return the entry, or NULL if there is none
+ */
+const cache_entry_t *cache_get(cache_t *, const char *key, size_t len);
+
+/**
+ * Claim an entry for +key+ of +len+ bytes, evicting another if
+ * needed.  The caller fills in +addr+ and +value+.
+ *
+ * @return the entry, or NULL if the cache is disabled or +key+ is
+ * longer than CACHE_KEY_MAX
+ */
+cache_entry_t *cache_put(cache_t *, const char *key, size_t len);
+
+#endif                          /* __CACHE_H__ */
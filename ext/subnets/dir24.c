@@ -0,0 +1,113 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dir24.h"
+
+#define TBL24_SIZE DIR24_TBL24_SIZE
+#define BLOCK_SIZE DIR24_BLOCK_SIZE
+
+/* tbl24 entries with this bit set hold an overflow block index */
+#define EXT ((uint32_t) 1 << 31)
+
+/*
+ * Other entries hold one more than the shortest prefixlen covering
+ * the entry, or zero if no prefix covers it.
+ */
+
+int
+dir24_init(dir24_t *dir) {
+  /* calloc of this size is served by lazily zeroed pages */
+  dir->tbl24 = calloc(TBL24_SIZE, sizeof(uint32_t));
+  dir->tbllong = NULL;
+  dir->nblocks = dir->capblocks = 0;
+  return dir->tbl24 ? 0 : -1;
+}
+
+void
+dir24_free(dir24_t *dir) {
+  free(dir->tbl24);
+  free(dir->tbllong);
+  dir->tbl24 = NULL;
+  dir->tbllong = NULL;
+  dir->nblocks = dir->capblocks = 0;
+}
+
+size_t
+dir24_memsize(const dir24_t *dir) {
+  return (dir->tbl24 ? TBL24_SIZE * sizeof(uint32_t) : 0) +
+    (size_t) dir->capblocks * BLOCK_SIZE;
+}
+
+int
+dir24_check(const dir24_t *dir) {
+  for (uint32_t i = 0; i < TBL24_SIZE; i++) {
+    uint32_t e = dir->tbl24[i];
+    if ((e & EXT) && (e & ~EXT) >= dir->nblocks) return -1;
+  }
+  return 0;
+}
+
+static int
+dir24_block_new(dir24_t *dir, uint8_t fill) {
+  if (dir->nblocks == dir->capblocks) {
+    uint32_t cap = dir->capblocks ? dir->capblocks * 2 : 64;
+    uint8_t *tbllong;
+    if (cap >= EXT) return -1;
+    tbllong = realloc(dir->tbllong, (size_t) cap * BLOCK_SIZE);
+    if (!tbllong) return -1;
+    dir->tbllong = tbllong;
+    dir->capblocks = cap;
+  }
+  memset(dir->tbllong + (size_t) dir->nblocks * BLOCK_SIZE, fill, BLOCK_SIZE);
+  return dir->nblocks++;
+}
+
+static void
+block_update(uint8_t *block, uint32_t start, uint32_t count, uint8_t v) {
+  for (uint32_t i = start; i < start + count; i++) {
+    if (!block[i] || block[i] > v) block[i] = v;
+  }
+}
+
+int
+dir24_insert(dir24_t *dir, ip4_t address, int prefixlen) {
+  address &= mk_mask4(prefixlen);
+
+  if (prefixlen <= 24) {
+    uint32_t start = address >> 8;
+    uint32_t count = (uint32_t) 1 << (24 - prefixlen);
+    uint32_t v = prefixlen + 1;
+
+    for (uint32_t i = start; i < start + count; i++) {
+      uint32_t e = dir->tbl24[i];
+      if (e & EXT) {
+        block_update(dir->tbllong + (size_t) (e & ~EXT) * BLOCK_SIZE, 0, BLOCK_SIZE, v);
+      } else if (!e || e > v) {
+        dir->tbl24[i] = v;
+      }
+    }
+  } else {
+    uint32_t i = address >> 8;
+    uint32_t e = dir->tbl24[i];
+
+    if (!(e & EXT)) {
+      int block = dir24_block_new(dir, e);
+      if (block < 0) return -1;
+      e = dir->tbl24[i] = EXT | block;
+    }
+
+    block_update(dir->tbllong + (size_t) (e & ~EXT) * BLOCK_SIZE,
+                 address & 0xff, (uint32_t) 1 << (32 - prefixlen), prefixlen + 1);
+  }
+
+  return 0;
+}
+
+int
+dir24_match(const dir24_t *dir, ip4_t ip, int prefixlen) {
+  uint32_t e = dir->tbl24[ip >> 8];
+  if (e & EXT) e = dir->tbllong[(size_t) (e & ~EXT) * BLOCK_SIZE + (ip & 0xff)];
+  return e && (int) e - 1 <= prefixlen;
+}
@@ -0,0 +1,68 @@
+#ifndef __DIR24_H__
+#define __DIR24_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ipaddr.h"
+
+/**
+ * A DIR-24-8 table of IPv4 prefixes: 2^24 first-level entries indexed
+ * by the top 24 bits of an address, plus 256-entry overflow blocks
+ * for those /24s covered by prefixes longer than 24 bits.  A lookup
+ * is at most two memory accesses regardless of the number of
+ * prefixes.
+ *
+ * Each entry records the shortest prefix covering that part of the
+ * address space, which is all that's needed to answer whether any
+ * prefix includes a given IP or network.
+ */
+#define DIR24_TBL24_SIZE (1 << 24) /* entries of tbl24 */
+#define DIR24_BLOCK_SIZE 256       /* entries of an overflow block */
+
+typedef struct {
+  uint32_t *tbl24;
+  uint8_t *tbllong;
+  uint32_t nblocks;
+  uint32_t capblocks;
+} dir24_t;
+
+/**
+ * Initialize an empty table.
+ *
+ * @return zero on success, -1 if the table could not be allocated
+ */
+int dir24_init(dir24_t *);
+
+/**
+ * Release the memory held by this table.
+ */
+void dir24_free(dir24_t *);
+
+/**
+ * Add the network +address+/+prefixlen+ to the table.
+ *
+ * @return zero on success, -1 if an overflow block could not be
+ * allocated
+ */
+int dir24_insert(dir24_t *, ip4_t address, int prefixlen);
+
+/**
+ * Test if any prefix of at most +prefixlen+ bits includes +ip+.
+ */
+int dir24_match(const dir24_t *, ip4_t ip, int prefixlen);
+
+/**
+ * Number of bytes held by this table.
+ */
+size_t dir24_memsize(const dir24_t *);
+
+/**
+ * Check that every overflow block index of this table is in range,
+ * so lookups in a table read from outside stay in bounds.
+ *
+ * @return zero if so, -1 if not
+ */
+int dir24_check(const dir24_t *);
+
+#endif                          /* __DIR24_H__ */
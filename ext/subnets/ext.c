@@ -1,8 +1,26 @@
 #include "ruby.h"
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+#include "ruby/thread.h"
+#endif
 
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+#include "ruby/ractor.h"
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 #include <stdio.h>
+#include <unistd.h>
 
 #include "ipaddr.h"
+#include "aggregate.h"
+#include "cache.h"
+#include "dir24.h"
+#include "image.h"
+#include "netlist.h"
+#include "sort.h"
+#include "trie.h"
 
 VALUE Subnets = Qnil;
 VALUE IP = Qnil;
@@ -11,12 +29,9 @@ VALUE IP6 = Qnil;
 VALUE Net = Qnil;
 VALUE Net4 = Qnil;
 VALUE Net6 = Qnil;
-
-VALUE rb_intern_hash = Qnil;
-VALUE rb_intern_xor = Qnil;
-
-#define hash(o) rb_funcall(o, rb_intern_hash, 0)
-#define xor(a,b) rb_funcall(a, rb_intern_xor, 1, b)
+VALUE Set = Qnil;
+VALUE Table = Qnil;
+VALUE LiveSet = Qnil;
 
 #define assert_kind_of(obj, kind) do {                                  \
     if (!rb_obj_is_kind_of(obj, kind)) {                                \
@@ -25,6 +40,7 @@ VALUE rb_intern_xor = Qnil;
   } while (0)
 
 #define MIN(a,b) ((a) > (b) ? (b) : (a))
+#define MAX(a,b) ((a) < (b) ? (b) : (a))
 
 /**
  * ParseError indicates the input string could not be parsed as the
@@ -32,51 +48,123 @@ VALUE rb_intern_xor = Qnil;
  */
 VALUE ParseError = Qnil;
 
+/**
+ * ImageError indicates a file is not a usable image of a Set.
+ */
+VALUE ImageError = Qnil;
+
 /* 49 is longest possible ip6 cidr */
 /* ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255/128 */
-#define raise_parse_error(type, data) do {                              \
-    if (strlen(data) > 49) {                                            \
+#define raise_parse_error(type, data, len) do {                         \
+    if ((len) > 49) {                                                   \
       rb_raise(ParseError, "failed to parse as %s: '%.45s...'", (type), (data)); \
     } else {                                                            \
-      rb_raise(ParseError, "failed to parse as %s: '%s'", (type), (data)); \
+      rb_raise(ParseError, "failed to parse as %s: '%.*s'", (type), (int) (len), (data)); \
     }                                                                   \
   } while (0)
 
-VALUE
-ip4_new(VALUE class, ip4_t src) {
-  ip4_t *ip;
-  VALUE v = Data_Make_Struct(class, ip4_t, 0, free, ip);
-  *ip = src;
-  rb_obj_call_init(v, 0, 0);
-  return v;
+/**
+ * Find the bytes of +str+ to parse: all of them, or +len+ bytes
+ * (default the rest) from +offset+.
+ *
+ * @return the first byte, with the number of bytes in +n+
+ */
+static const char *
+str_slice(VALUE *str, VALUE offset, VALUE len, long *n) {
+  long off, size;
+
+  StringValue(*str);
+  size = RSTRING_LEN(*str);
+  off = Qnil == offset ? 0 : NUM2LONG(offset);
+  *n = Qnil == len ? size - off : NUM2LONG(len);
+  if (off < 0 || off > size || *n < 0 || *n > size - off) {
+    rb_raise(rb_eIndexError, "offset %ld and length %ld out of string of %ld bytes", off, *n, size);
+  }
+  return RSTRING_PTR(*str) + off;
 }
 
-VALUE
-ip6_new(VALUE class, ip6_t src) {
-  ip6_t *ip;
-  VALUE v = Data_Make_Struct(class, ip6_t, 0, free, ip);
-  *ip = src;
-  rb_obj_call_init(v, 0, 0);
-  return v;
+#ifdef HAVE_CONST_RUBY_TYPED_EMBEDDABLE
+#define SUBNETS_TYPED_EMBEDDABLE RUBY_TYPED_EMBEDDABLE
+#else
+#define SUBNETS_TYPED_EMBEDDABLE 0
+#endif
+
+#ifdef HAVE_CONST_RUBY_TYPED_FROZEN_SHAREABLE
+#define SUBNETS_TYPED_SHAREABLE RUBY_TYPED_FROZEN_SHAREABLE
+#else
+#define SUBNETS_TYPED_SHAREABLE 0
+#endif
+
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+/* set only in the main Ractor, which loads the extension */
+static rb_ractor_local_key_t main_ractor_key;
+
+static int
+main_ractor_p(void) {
+  VALUE v;
+  return rb_ractor_local_storage_value_lookup(main_ractor_key, &v);
 }
+#else
+#define main_ractor_p() 1
+#endif
 
-VALUE
-net4_new(VALUE class, net4_t src) {
-  net4_t *net;
-  VALUE rbnet = Data_Make_Struct(class, net4_t, 0, free, net);
-  *net = src;
-  rb_obj_call_init(rbnet, 0, 0);
-  return rbnet;
+/**
+ * Raise unless called from the main Ractor, for settings shared by
+ * all Ractors.
+ */
+static void
+check_main_ractor(const char *setting) {
+  if (!main_ractor_p()) {
+    rb_raise(rb_path2class("Ractor::IsolationError"),
+             "Subnets.%s can only be set from the main Ractor", setting);
+  }
 }
 
-VALUE
-net6_new(VALUE class, net6_t src) {
-  net6_t *net;
-  VALUE rbnet = Data_Make_Struct(class, net6_t, 0, free, net);
-  *net = src;
-  rb_obj_call_init(rbnet, 0, 0);
-  return rbnet;
-}
+/*
+ * IPs and nets are small, immutable values stored inside the object
+ * itself where the Ruby supports it, so allocating one costs no
+ * malloc.  They are frozen from the start, so may be shared between
+ * Ractors.
+ */
+#define DEFINE_VALUE_TYPE(name)                                         \
+  static size_t                                                         \
+  name##_memsize(const void *p) {                                       \
+    return sizeof(name##_t);                                            \
+  }                                                                     \
+                                                                        \
+  static const rb_data_type_t name##_type = {                           \
+    .wrap_struct_name = "Subnets::" #name,                              \
+    .function = {                                                       \
+      .dfree = RUBY_TYPED_DEFAULT_FREE,                                 \
+      .dsize = name##_memsize,                                          \
+    },                                                                  \
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY | SUBNETS_TYPED_EMBEDDABLE |   \
+             SUBNETS_TYPED_SHAREABLE,                                   \
+  };                                                                    \
+                                                                        \
+  VALUE                                                                 \
+  name##_new(VALUE class, name##_t src) {                               \
+    name##_t *p;                                                        \
+    VALUE v = TypedData_Make_Struct(class, name##_t, &name##_type, p);  \
+    *p = src;                                                           \
+    RB_OBJ_FREEZE(v);                                                   \
+    return v;                                                           \
+  }
+
+/*
+ * The struct of a value whose class was already checked to be one of
+ * those below, without checking its type again.
+ */
+#ifdef HAVE_CONST_RUBY_TYPED_EMBEDDABLE
+#define VALUE_DATA(v) RTYPEDDATA_GET_DATA(v)
+#else
+#define VALUE_DATA(v) DATA_PTR(v)
+#endif
+
+DEFINE_VALUE_TYPE(ip4)
+DEFINE_VALUE_TYPE(ip6)
+DEFINE_VALUE_TYPE(net4)
+DEFINE_VALUE_TYPE(net6)
 
 VALUE
 method_ip4_new(VALUE class, VALUE address) {
@@ -85,17 +173,17 @@ method_ip4_new(VALUE class, VALUE address) {
 
 VALUE
 method_ip6_new(VALUE class, VALUE hextets) {
-  ip6_t ip;
+  uint16_t x[8];
 
   if (RARRAY_LEN(hextets) != 8) {
     rb_raise(rb_eArgError, "hextets must be size=8, was %ld", RARRAY_LEN(hextets));
   }
 
   for (ssize_t i = 0; i < RARRAY_LEN(hextets); i++) {
-    ip.x[i] = NUM2INT(RARRAY_AREF(hextets, i)) & 0xffff;
+    x[i] = NUM2INT(RARRAY_AREF(hextets, i)) & 0xffff;
   }
 
-  return ip6_new(class, ip);
+  return ip6_new(class, ip6_from_hextets(x));
 }
 
 VALUE
@@ -113,14 +201,16 @@ method_net4_new(VALUE class, VALUE address, VALUE prefixlen) {
 VALUE
 method_net6_new(VALUE class, VALUE hextets, VALUE prefixlen) {
   net6_t net;
+  uint16_t x[8];
 
   if (RARRAY_LEN(hextets) != 8) {
     rb_raise(rb_eArgError, "hextets must be size=8, was %ld", RARRAY_LEN(hextets));
   }
 
   for (ssize_t i = 0; i < RARRAY_LEN(hextets); i++) {
-    net.address.x[i] = NUM2INT(RARRAY_AREF(hextets, i)) & 0xffff;
+    x[i] = NUM2INT(RARRAY_AREF(hextets, i)) & 0xffff;
   }
+  net.address = ip6_from_hextets(x);
 
   net.prefixlen = NUM2INT(prefixlen);
   if (!(net.prefixlen >= 0 && net.prefixlen <= 128)) {
@@ -135,17 +225,25 @@ method_net6_new(VALUE class, VALUE hextets, VALUE prefixlen) {
 /**
  * Parse +s+ as an IPv4 network in CIDR notation.
  *
- * @param [String] s
+ * @overload parse(s, offset=0, len=s.bytesize-offset)
+ *   @param [String] s
+ *   @param [Integer] offset parse only the +len+ bytes of +s+ from
+ *     +offset+, without creating a substring
+ *   @param [Integer] len
  * @return {Net4}
  * @raise {Subnets::ParseError}
  */
 VALUE
-method_net4_parse(VALUE class, VALUE s) {
-  const char *buf = StringValueCStr(s);
-
+method_net4_parse(int argc, VALUE *argv, VALUE class) {
+  VALUE s, offset, len;
+  const char *buf;
+  long n;
   net4_t net;
-  if (!read_net4_strict(buf, &net)) {
-    raise_parse_error("net4", buf);
+
+  rb_scan_args(argc, argv, "12", &s, &offset, &len);
+  buf = str_slice(&s, offset, len, &n);
+  if (!read_net4_strict_n(buf, n, &net)) {
+    raise_parse_error("net4", buf, n);
   }
   return net4_new(class, net);
 }
@@ -164,17 +262,25 @@ method_net4_parse(VALUE class, VALUE s) {
  *   portion as above defining up to six hextets, followed by
  *   dot-separated decimal numbers 0-255 in typical IPv4 format.
  *
- * @param [String] s
+ * @overload parse(s, offset=0, len=s.bytesize-offset)
+ *   @param [String] s
+ *   @param [Integer] offset parse only the +len+ bytes of +s+ from
+ *     +offset+, without creating a substring
+ *   @param [Integer] len
  * @return {Net6}
  * @raise {Subnets::ParseError}
  */
 VALUE
-method_net6_parse(VALUE class, VALUE s) {
-  const char *buf = StringValueCStr(s);
-
+method_net6_parse(int argc, VALUE *argv, VALUE class) {
+  VALUE s, offset, len;
+  const char *buf;
+  long n;
   net6_t net;
-  if (!read_net6_strict(buf, &net)) {
-    raise_parse_error("net6", buf);
+
+  rb_scan_args(argc, argv, "12", &s, &offset, &len);
+  buf = str_slice(&s, offset, len, &n);
+  if (!read_net6_strict_n(buf, n, &net)) {
+    raise_parse_error("net6", buf, n);
   }
   return net6_new(class, net);
 }
@@ -229,6 +335,7 @@ void
 ip6_fill_random(ip6_t *ip, VALUE rng, VALUE opts) {
   VALUE rand;
   int pre, zeros;
+  uint16_t x[8];
 
   if (Qnil == rng) {
     rng = rb_funcall(rb_cRandom, rb_intern("new"), 0);
@@ -245,14 +352,15 @@ ip6_fill_random(ip6_t *ip, VALUE rng, VALUE opts) {
   }
 
   for (int i=0; i<pre; i++) {
-    ip->x[i] = FIX2INT(rb_funcall(rng, rand, 1, INT2FIX(0xffff+1)));
+    x[i] = FIX2INT(rb_funcall(rng, rand, 1, INT2FIX(0xffff+1)));
   }
   for (int i=pre; i<pre+zeros; i++) {
-    ip->x[i] = 0;
+    x[i] = 0;
   }
   for (int i=pre+zeros; i<8; i++) {
-    ip->x[i] = FIX2INT(rb_funcall(rng, rand, 1, INT2FIX(0xffff+1)));
+    x[i] = FIX2INT(rb_funcall(rng, rand, 1, INT2FIX(0xffff+1)));
   }
+  *ip = ip6_from_hextets(x);
 }
 
 /**
@@ -300,7 +408,7 @@ method_net6_random(int argc, VALUE *argv, VALUE class) {
 VALUE
 method_ip4_not(VALUE self) {
   ip4_t *ip;
-  Data_Get_Struct(self, ip4_t, ip);
+  TypedData_Get_Struct(self, ip4_t, &ip4_type, ip);
   return ip4_new(IP4, ~ *ip);
 }
 
@@ -314,8 +422,8 @@ method_ip4_bor(VALUE self, VALUE other) {
 
   assert_kind_of(other, IP4);
 
-  Data_Get_Struct(self, ip4_t, a);
-  Data_Get_Struct(other, ip4_t, b);
+  TypedData_Get_Struct(self, ip4_t, &ip4_type, a);
+  TypedData_Get_Struct(other, ip4_t, &ip4_type, b);
   return ip4_new(IP4, *a | *b);
 }
 
@@ -329,8 +437,8 @@ method_ip4_xor(VALUE self, VALUE other) {
 
   assert_kind_of(other, IP4);
 
-  Data_Get_Struct(self, ip4_t, a);
-  Data_Get_Struct(other, ip4_t, b);
+  TypedData_Get_Struct(self, ip4_t, &ip4_type, a);
+  TypedData_Get_Struct(other, ip4_t, &ip4_type, b);
   return ip4_new(IP4, *a ^ *b);
 }
 
@@ -344,8 +452,8 @@ method_ip4_band(VALUE self, VALUE other) {
 
   assert_kind_of(other, IP4);
 
-  Data_Get_Struct(self, ip4_t, a);
-  Data_Get_Struct(other, ip4_t, b);
+  TypedData_Get_Struct(self, ip4_t, &ip4_type, a);
+  TypedData_Get_Struct(other, ip4_t, &ip4_type, b);
   return ip4_new(IP4, *a & *b);
 }
 
@@ -355,7 +463,7 @@ method_ip4_band(VALUE self, VALUE other) {
 VALUE
 method_ip6_not(VALUE self) {
   ip6_t *ip;
-  Data_Get_Struct(self, ip6_t, ip);
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, ip);
   return ip6_new(IP6, ip6_not(*ip));
 }
 
@@ -369,8 +477,8 @@ method_ip6_bor(VALUE self, VALUE other) {
 
   assert_kind_of(other, IP6);
 
-  Data_Get_Struct(self, ip6_t, a);
-  Data_Get_Struct(other, ip6_t, b);
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, a);
+  TypedData_Get_Struct(other, ip6_t, &ip6_type, b);
 
   return ip6_new(IP6, ip6_bor(*a, *b));
 }
@@ -385,8 +493,8 @@ method_ip6_xor(VALUE self, VALUE other) {
 
   assert_kind_of(other, IP6);
 
-  Data_Get_Struct(self, ip6_t, a);
-  Data_Get_Struct(other, ip6_t, b);
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, a);
+  TypedData_Get_Struct(other, ip6_t, &ip6_type, b);
 
   return ip6_new(IP6, ip6_xor(*a, *b));
 }
@@ -401,8 +509,8 @@ method_ip6_band(VALUE self, VALUE other) {
 
   assert_kind_of(other, IP6);
 
-  Data_Get_Struct(self, ip6_t, a);
-  Data_Get_Struct(other, ip6_t, b);
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, a);
+  TypedData_Get_Struct(other, ip6_t, &ip6_type, b);
 
   return ip6_new(IP6, ip6_band(*a, *b));
 }
@@ -416,7 +524,7 @@ method_ip6_band(VALUE self, VALUE other) {
 VALUE
 method_net4_prefixlen(VALUE self) {
   net4_t *net;
-  Data_Get_Struct(self, net4_t, net);
+  TypedData_Get_Struct(self, net4_t, &net4_type, net);
   return INT2FIX(net->prefixlen);
 }
 
@@ -426,10 +534,94 @@ method_net4_prefixlen(VALUE self) {
 VALUE
 method_net6_prefixlen(VALUE self) {
   net6_t *net;
-  Data_Get_Struct(self, net6_t, net);
+  TypedData_Get_Struct(self, net6_t, &net6_type, net);
   return INT2FIX(net->prefixlen);
 }
 
+/* raise unless v is an Integer, rather than converting with to_int */
+static void
+check_integer(VALUE v) {
+  if (!RB_INTEGER_TYPE_P(v)) {
+    rb_raise(rb_eTypeError, "wrong argument type %s (expected Integer)", rb_obj_classname(v));
+  }
+}
+
+/**
+ * Read the Integer +v+ as an IPv4 address, without allocating.
+ *
+ * @raise [TypeError] unless +v+ is an Integer
+ * @raise [RangeError] unless 0 <= +v+ < 2**32
+ */
+static ip4_t
+ip4_of_integer(VALUE v) {
+  const int flags = INTEGER_PACK_MSWORD_FIRST | INTEGER_PACK_NATIVE_BYTE_ORDER;
+  uint32_t ip;
+
+  if (RB_FIXNUM_P(v)) {
+    long n = FIX2LONG(v);
+    if (n >= 0 && (unsigned long) n <= UINT32_MAX) return n;
+  } else {
+    check_integer(v);
+    /* sign 0 or 1 without overflow */
+    if ((unsigned) rb_integer_pack(v, &ip, 1, sizeof(ip), 0, flags) <= 1) return ip;
+  }
+  rb_raise(rb_eRangeError, "IPv4 address must be in range [0,2**32), was %"PRIsVALUE, v);
+}
+
+/**
+ * Read the Integer +v+ as an IPv6 address, without allocating.
+ *
+ * @raise [TypeError] unless +v+ is an Integer
+ * @raise [RangeError] unless 0 <= +v+ < 2**128
+ */
+static ip6_t
+ip6_of_integer(VALUE v) {
+  const int flags = INTEGER_PACK_MSWORD_FIRST | INTEGER_PACK_NATIVE_BYTE_ORDER;
+  uint64_t words[2];
+  ip6_t ip;
+
+  if (RB_FIXNUM_P(v) && FIX2LONG(v) >= 0) {
+    ip.hi = 0;
+    ip.lo = FIX2LONG(v);
+    return ip;
+  }
+  check_integer(v);
+  if ((unsigned) rb_integer_pack(v, words, 2, sizeof(words[0]), 0, flags) > 1) {
+    rb_raise(rb_eRangeError, "IPv6 address must be in range [0,2**128), was %"PRIsVALUE, v);
+  }
+  ip.hi = words[0];
+  ip.lo = words[1];
+  return ip;
+}
+
+/**
+ * Test if this network includes the IPv4 address +i+, as by
+ * {#include?} of +IP4.new(i)+ but without making the IP4.
+ *
+ * @param [Integer] i
+ * @raise [RangeError] unless 0 <= +i+ < 2**32
+ */
+VALUE
+method_net4_include_i_p(VALUE self, VALUE i) {
+  net4_t *net;
+  TypedData_Get_Struct(self, net4_t, &net4_type, net);
+  return net4_include_p(*net, ip4_of_integer(i)) ? Qtrue : Qfalse;
+}
+
+/**
+ * Test if this network includes the IPv6 address +i+, as by
+ * {#include?} of the IP6 with that value but without making it.
+ *
+ * @param [Integer] i
+ * @raise [RangeError] unless 0 <= +i+ < 2**128
+ */
+VALUE
+method_net6_include_i_p(VALUE self, VALUE i) {
+  net6_t *net;
+  TypedData_Get_Struct(self, net6_t, &net6_type, net);
+  return net6_include_p(*net, ip6_of_integer(i)) ? Qtrue : Qfalse;
+}
+
 /**
  * Test if this network includes +v+.
  *
@@ -443,35 +635,27 @@ method_net6_prefixlen(VALUE self) {
 VALUE
 method_net4_include_p(VALUE self, VALUE v) {
   net4_t *net;
-  Data_Get_Struct(self, net4_t, net);
+  TypedData_Get_Struct(self, net4_t, &net4_type, net);
 
   if (CLASS_OF(v) == IP4) {
     ip4_t *ip;
-    Data_Get_Struct(v, ip4_t, ip);
+    TypedData_Get_Struct(v, ip4_t, &ip4_type, ip);
     return net4_include_p(*net, *ip) ? Qtrue : Qfalse;
   } else if (CLASS_OF(v) == Net4) {
     net4_t *other;
-    Data_Get_Struct(v, net4_t, other);
+    TypedData_Get_Struct(v, net4_t, &net4_type, other);
     return net4_include_net4_p(*net, *other) ? Qtrue : Qfalse;
   } else if (CLASS_OF(v) == IP6 || CLASS_OF(v) == Net6) {
     return Qfalse;
   } else {
+    addr_t addr;
     v = StringValue(v);
 
-    {
-      net4_t other;
-      if (read_net4_strict(RSTRING_PTR(v), &other)) {
-        return net4_include_net4_p(*net, other) ? Qtrue : Qfalse;
-      }
-    }
-    {
-      ip4_t ip;
-      if (read_ip4_strict(RSTRING_PTR(v), &ip)) {
-        return net4_include_p(*net, ip) ? Qtrue : Qfalse;
-      }
+    switch (read_any_strict_n(RSTRING_PTR(v), RSTRING_LEN(v), &addr) ? addr.type : ADDR_NONE) {
+    case ADDR_NET4: return net4_include_net4_p(*net, addr.u.net4) ? Qtrue : Qfalse;
+    case ADDR_IP4: return net4_include_p(*net, addr.u.ip4) ? Qtrue : Qfalse;
+    default: return Qfalse;
     }
-
-    return Qfalse;
   }
 }
 
@@ -488,32 +672,25 @@ method_net4_include_p(VALUE self, VALUE v) {
 VALUE
 method_net6_include_p(VALUE self, VALUE v) {
   net6_t *net;
-  Data_Get_Struct(self, net6_t, net);
+  TypedData_Get_Struct(self, net6_t, &net6_type, net);
 
   if (CLASS_OF(v) == IP6) {
     ip6_t *ip;
-    Data_Get_Struct(v, ip6_t, ip);
+    TypedData_Get_Struct(v, ip6_t, &ip6_type, ip);
     return net6_include_p(*net, *ip) ? Qtrue : Qfalse;
   } else if (CLASS_OF(v) == Net6) {
     net6_t *other;
-    Data_Get_Struct(v, net6_t, other);
+    TypedData_Get_Struct(v, net6_t, &net6_type, other);
     return net6_include_net6_p(*net, *other) ? Qtrue : Qfalse;
   } else if (CLASS_OF(v) == IP4 || CLASS_OF(v) == Net4) {
     return Qfalse;
   } else if (rb_obj_is_kind_of(v, rb_cString)) {
-    const char *buf = StringValueCStr(v);
+    addr_t addr;
 
-    {
-      net6_t other;
-      if (read_net6_strict(buf, &other)) {
-        return net6_include_net6_p(*net, other) ? Qtrue : Qfalse;
-      }
-    }
-    {
-      ip6_t ip;
-      if (read_ip6_strict(buf, &ip)) {
-        return net6_include_p(*net, ip) ? Qtrue : Qfalse;
-      }
+    switch (read_any_strict_n(RSTRING_PTR(v), RSTRING_LEN(v), &addr) ? addr.type : ADDR_NONE) {
+    case ADDR_NET6: return net6_include_net6_p(*net, addr.u.net6) ? Qtrue : Qfalse;
+    case ADDR_IP6: return net6_include_p(*net, addr.u.ip6) ? Qtrue : Qfalse;
+    default: return Qfalse;
     }
   }
 
@@ -528,11 +705,11 @@ method_net6_include_p(VALUE self, VALUE v) {
 VALUE
 method_ip4_to_s(VALUE self) {
   ip4_t *ip;
-  char buf[16];
+  VALUE str = rb_str_buf_new(IP4_FORMAT_MAX + FORMAT_SLACK);
 
-  Data_Get_Struct(self, ip4_t, ip);
-  ip4_snprint(*ip, buf, 16);
-  return rb_str_new2(buf);
+  TypedData_Get_Struct(self, ip4_t, &ip4_type, ip);
+  rb_str_set_len(str, ip4_format(*ip, RSTRING_PTR(str)));
+  return str;
 }
 
 /**
@@ -544,11 +721,11 @@ method_ip4_to_s(VALUE self) {
 VALUE
 method_ip6_to_s(VALUE self) {
   ip6_t *ip;
-  char buf[64];
+  VALUE str = rb_str_buf_new(IP6_FORMAT_MAX + FORMAT_SLACK);
 
-  Data_Get_Struct(self, ip6_t, ip);
-  ip6_snprint(*ip, buf, 64);
-  return rb_str_new2(buf);
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, ip);
+  rb_str_set_len(str, ip6_format(*ip, RSTRING_PTR(str)));
+  return str;
 }
 
 /**
@@ -559,11 +736,11 @@ method_ip6_to_s(VALUE self) {
 VALUE
 method_net4_to_s(VALUE self) {
   net4_t *net;
-  char buf[32];
+  VALUE str = rb_str_buf_new(NET4_FORMAT_MAX + FORMAT_SLACK);
 
-  Data_Get_Struct(self, net4_t, net);
-  net4_snprint(*net, buf, 32);
-  return rb_str_new2(buf);
+  TypedData_Get_Struct(self, net4_t, &net4_type, net);
+  rb_str_set_len(str, net4_format(*net, RSTRING_PTR(str)));
+  return str;
 }
 
 /**
@@ -574,11 +751,11 @@ method_net4_to_s(VALUE self) {
 VALUE
 method_net6_to_s(VALUE self) {
   net6_t *net;
-  char buf[64];
+  VALUE str = rb_str_buf_new(NET6_FORMAT_MAX + FORMAT_SLACK);
 
-  Data_Get_Struct(self, net6_t, net);
-  net6_snprint(*net, buf, 64);
-  return rb_str_new2(buf);
+  TypedData_Get_Struct(self, net6_t, &net6_type, net);
+  rb_str_set_len(str, net6_format(*net, RSTRING_PTR(str)));
+  return str;
 }
 
 /**
@@ -587,7 +764,7 @@ method_net6_to_s(VALUE self) {
 VALUE
 method_ip4_to_i(VALUE self) {
   ip4_t *ip;
-  Data_Get_Struct(self, ip4_t, ip);
+  TypedData_Get_Struct(self, ip4_t, &ip4_type, ip);
   return RB_UINT2NUM(*ip);
 }
 
@@ -600,7 +777,7 @@ method_ip6_to_i(VALUE self) {
   ip6_t *ip;
   ID lshift, plus;
 
-  Data_Get_Struct(self, ip6_t, ip);
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, ip);
 
   lshift = rb_intern("<<");
   plus = rb_intern("+");
@@ -608,7 +785,7 @@ method_ip6_to_i(VALUE self) {
   ret = RB_INT2NUM(0);
 
   for (int i=0; i<8; i++) {
-    VALUE hextet = RB_UINT2NUM(ip->x[i]);
+    VALUE hextet = RB_UINT2NUM(ip6_hextet(*ip, i));
     VALUE inc = rb_funcall(hextet, lshift, 1, RB_INT2NUM(16*(7-i)));
     ret = rb_funcall(ret, plus, 1, inc);
   }
@@ -627,12 +804,86 @@ method_ip4_eql_p(VALUE self, VALUE other) {
     return Qfalse;
   }
 
-  Data_Get_Struct(self, ip4_t, a);
-  Data_Get_Struct(other, ip4_t, b);
+  TypedData_Get_Struct(self, ip4_t, &ip4_type, a);
+  TypedData_Get_Struct(other, ip4_t, &ip4_type, b);
 
   return (*a == *b) ? Qtrue : Qfalse;
 }
 
+/**
+ * Order IPs by address and nets by address and then prefixlen.
+ *
+ * @return [Integer, nil] -1, 0 or 1, or nil unless +other+ is of the
+ *   same class
+ */
+VALUE
+method_ip4_cmp(VALUE self, VALUE other) {
+  ip4_t *a, *b;
+
+  if (CLASS_OF(other) != CLASS_OF(self)) {
+    return Qnil;
+  }
+
+  TypedData_Get_Struct(self, ip4_t, &ip4_type, a);
+  TypedData_Get_Struct(other, ip4_t, &ip4_type, b);
+
+  return INT2FIX((*a > *b) - (*a < *b));
+}
+
+/**
+ * (see Subnets::IP4#<=>)
+ */
+VALUE
+method_ip6_cmp(VALUE self, VALUE other) {
+  ip6_t *a, *b;
+
+  if (CLASS_OF(other) != CLASS_OF(self)) {
+    return Qnil;
+  }
+
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, a);
+  TypedData_Get_Struct(other, ip6_t, &ip6_type, b);
+
+  return INT2FIX(ip6_cmp(*a, *b));
+}
+
+/**
+ * (see Subnets::IP4#<=>)
+ */
+VALUE
+method_net4_cmp(VALUE self, VALUE other) {
+  net4_t *a, *b;
+
+  if (CLASS_OF(other) != CLASS_OF(self)) {
+    return Qnil;
+  }
+
+  TypedData_Get_Struct(self, net4_t, &net4_type, a);
+  TypedData_Get_Struct(other, net4_t, &net4_type, b);
+
+  if (a->address != b->address) return INT2FIX(a->address < b->address ? -1 : 1);
+  return INT2FIX((a->prefixlen > b->prefixlen) - (a->prefixlen < b->prefixlen));
+}
+
+/**
+ * (see Subnets::IP4#<=>)
+ */
+VALUE
+method_net6_cmp(VALUE self, VALUE other) {
+  net6_t *a, *b;
+  int c;
+
+  if (CLASS_OF(other) != CLASS_OF(self)) {
+    return Qnil;
+  }
+
+  TypedData_Get_Struct(self, net6_t, &net6_type, a);
+  TypedData_Get_Struct(other, net6_t, &net6_type, b);
+
+  if ((c = ip6_cmp(a->address, b->address))) return INT2FIX(c);
+  return INT2FIX((a->prefixlen > b->prefixlen) - (a->prefixlen < b->prefixlen));
+}
+
 /**
  * @return [Boolean]
  */
@@ -644,8 +895,8 @@ method_net4_eql_p(VALUE self, VALUE other) {
     return Qfalse;
   }
 
-  Data_Get_Struct(self, net4_t, a);
-  Data_Get_Struct(other, net4_t, b);
+  TypedData_Get_Struct(self, net4_t, &net4_type, a);
+  TypedData_Get_Struct(other, net4_t, &net4_type, b);
 
   if (a->prefixlen != b->prefixlen) {
     return Qfalse;
@@ -667,8 +918,8 @@ method_ip6_eql_p(VALUE self, VALUE other) {
     return Qfalse;
   }
 
-  Data_Get_Struct(self, ip6_t, a);
-  Data_Get_Struct(other, ip6_t, b);
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, a);
+  TypedData_Get_Struct(other, ip6_t, &ip6_type, b);
 
   return ip6_eql_p(*a, *b) ? Qtrue : Qfalse;
 }
@@ -684,27 +935,26 @@ method_net6_eql_p(VALUE self, VALUE other) {
     return Qfalse;
   }
 
-  Data_Get_Struct(self, net6_t, a);
-  Data_Get_Struct(other, net6_t, b);
+  TypedData_Get_Struct(self, net6_t, &net6_type, a);
+  TypedData_Get_Struct(other, net6_t, &net6_type, b);
 
   if (a->prefixlen != b->prefixlen) {
     return Qfalse;
   }
 
-  for (int i=0; i<8; i++) {
-    if (a->address.x[i] != b->address.x[i]) return Qfalse;
-  }
-  return Qtrue;
+  return ip6_eql_p(a->address, b->address) ? Qtrue : Qfalse;
 }
 
 /**
+ * Hash over the raw address bytes, seeded like Ruby's own hashing.
+ *
  * @return [Integer]
  */
 VALUE
 method_ip4_hash(VALUE self) {
   ip4_t *ip;
-  Data_Get_Struct(self, ip4_t, ip);
-  return hash(UINT2NUM(*ip));
+  TypedData_Get_Struct(self, ip4_t, &ip4_type, ip);
+  return ST2FIX(rb_hash_end(rb_hash_uint32(rb_hash_start(0), *ip)));
 }
 
 /**
@@ -713,8 +963,13 @@ method_ip4_hash(VALUE self) {
 VALUE
 method_net4_hash(VALUE self) {
   net4_t *net;
-  Data_Get_Struct(self, net4_t, net);
-  return xor(hash(INT2FIX(net->prefixlen)), hash(UINT2NUM(net->address)));
+  st_index_t h;
+
+  TypedData_Get_Struct(self, net4_t, &net4_type, net);
+
+  h = rb_hash_start(net->prefixlen);
+  h = rb_hash_uint32(h, net->address);
+  return ST2FIX(rb_hash_end(h));
 }
 
 /**
@@ -723,15 +978,8 @@ method_net4_hash(VALUE self) {
 VALUE
 method_ip6_hash(VALUE self) {
   ip6_t *ip;
-  VALUE ret;
-
-  Data_Get_Struct(self, ip6_t, ip);
-
-  ret = hash(INT2FIX(ip->x[0]));
-  for (int i=1; i<8; i++) {
-    ret = xor(ret, hash(INT2FIX(ip->x[i])));
-  }
-  return ret;
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, ip);
+  return ST2FIX(rb_memhash(ip, sizeof(*ip)));
 }
 
 /**
@@ -740,21 +988,20 @@ method_ip6_hash(VALUE self) {
 VALUE
 method_net6_hash(VALUE self) {
   net6_t *net;
-  VALUE ret;
+  st_index_t h;
 
-  Data_Get_Struct(self, net6_t, net);
+  TypedData_Get_Struct(self, net6_t, &net6_type, net);
 
-  ret = hash(INT2FIX(net->prefixlen));
-  for (int i=0; i<8; i++) {
-    ret = xor(ret, hash(INT2FIX(net->address.x[i])));
-  }
-  return ret;
+  /* mask is derived from prefixlen, so it is left out */
+  h = rb_hash_start(net->prefixlen);
+  h = rb_hash_uint(h, rb_memhash(&net->address, sizeof(net->address)));
+  return ST2FIX(rb_hash_end(h));
 }
 
 VALUE
 method_net4_network(VALUE self) {
   net4_t *addr;
-  Data_Get_Struct(self, net4_t, addr);
+  TypedData_Get_Struct(self, net4_t, &net4_type, addr);
 
   return net4_new(Net4, net4_network(*addr));
 }
@@ -762,28 +1009,28 @@ method_net4_network(VALUE self) {
 VALUE
 method_net4_address(VALUE self) {
   net4_t *net;
-  Data_Get_Struct(self, net4_t, net);
+  TypedData_Get_Struct(self, net4_t, &net4_type, net);
   return ip4_new(IP4, net->address);
 }
 
 VALUE
 method_net6_address(VALUE self) {
   net6_t *net;
-  Data_Get_Struct(self, net6_t, net);
+  TypedData_Get_Struct(self, net6_t, &net6_type, net);
   return ip6_new(IP6, net->address);
 }
 
 VALUE
 method_net4_mask(VALUE self) {
   net4_t *net;
-  Data_Get_Struct(self, net4_t, net);
+  TypedData_Get_Struct(self, net4_t, &net4_type, net);
   return ip4_new(IP4, net->mask);
 }
 
 VALUE
 method_net6_mask(VALUE self) {
   net6_t *net;
-  Data_Get_Struct(self, net6_t, net);
+  TypedData_Get_Struct(self, net6_t, &net6_type, net);
   return ip6_new(IP6, net->mask);
 }
 
@@ -795,11 +1042,11 @@ method_ip6_hextets(VALUE self) {
   ip6_t *ip;
   VALUE hextets;
 
-  Data_Get_Struct(self, ip6_t, ip);
+  TypedData_Get_Struct(self, ip6_t, &ip6_type, ip);
 
   hextets = rb_ary_new();
   for (int i=0; i<8; i++) {
-    rb_ary_push(hextets, INT2FIX(ip->x[i]));
+    rb_ary_push(hextets, INT2FIX(ip6_hextet(*ip, i)));
   }
   return hextets;
 }
@@ -812,11 +1059,11 @@ method_net6_hextets(VALUE self) {
   net6_t *net;
   VALUE hextets;
 
-  Data_Get_Struct(self, net6_t, net);
+  TypedData_Get_Struct(self, net6_t, &net6_type, net);
 
   hextets = rb_ary_new();
   for (int i=0; i<8; i++) {
-    rb_ary_push(hextets, INT2FIX(net->address.x[i]));
+    rb_ary_push(hextets, INT2FIX(ip6_hextet(net->address, i)));
   }
   return hextets;
 }
@@ -837,19 +1084,17 @@ method_net4_summarize(VALUE class, VALUE nets) {
 
     assert_kind_of(rbnet, Net4);
 
-    Data_Get_Struct(rbnet, net4_t, net);
+    TypedData_Get_Struct(rbnet, net4_t, &net4_type, net);
 
     if (i == 0) {
       result.address = (net->address & net->mask);
       result.prefixlen = net->prefixlen;
       result.mask = net->mask;
     } else {
-      while (result.prefixlen > net->prefixlen ||
-             result.address != (net->address & result.mask)) {
-        result.prefixlen = MIN(result.prefixlen-1, net->prefixlen);
-        result.mask = mk_mask4(result.prefixlen);
-        result.address &= result.mask;
-      }
+      int common = ip4_common_prefixlen(result.address, net->address);
+      result.prefixlen = MIN(MIN(result.prefixlen, net->prefixlen), common);
+      result.mask = mk_mask4(result.prefixlen);
+      result.address &= result.mask;
     }
   }
 
@@ -872,62 +1117,242 @@ method_net6_summarize(VALUE class, VALUE nets) {
 
     assert_kind_of(rbnet, Net6);
 
-    Data_Get_Struct(rbnet, net6_t, net);
+    TypedData_Get_Struct(rbnet, net6_t, &net6_type, net);
 
     if (i == 0) {
       result.address = ip6_band(net->address, net->mask);
       result.prefixlen = net->prefixlen;
       result.mask = net->mask;
     } else {
-      while(result.prefixlen > net->prefixlen ||
-            !ip6_eql_p(result.address, ip6_band(net->address, result.mask))) {
-        result.prefixlen = MIN(result.prefixlen-1, net->prefixlen);
-        result.mask = mk_mask6(result.prefixlen);
-        result.address = ip6_band(result.address, result.mask);
-      }
+      int common = ip6_common_prefixlen(result.address, net->address);
+      result.prefixlen = MIN(MIN(result.prefixlen, net->prefixlen), common);
+      result.mask = mk_mask6(result.prefixlen);
+      result.address = ip6_band(result.address, result.mask);
     }
   }
 
   return net6_new(class, result);
 }
 
+/**
+ * Parse the +len+ bytes of +buf+ as Net4, Net6, IP4, IP6 into +addr+.
+ *
+ * @return the type of address read, ADDR_NONE on parse error
+ */
+static addr_type_t
+addr_read(const char *buf, size_t len, addr_t *addr) {
+  read_any_strict_n(buf, len, addr);
+  return addr->type;
+}
+
+/*
+ * Strings parsed by Subnets.parse, Subnets.include? and friends are
+ * looked up in this cache first, once enabled with
+ * Subnets.parse_cache_size=.  Failed parses are cached too.  Only the
+ * main Ractor uses the cache; others parse every string.
+ */
+static cache_t parse_cache;
+
+/**
+ * Like addr_read, but through the parse cache.
+ */
+static addr_type_t
+addr_read_cached(const char *buf, size_t len, addr_t *addr) {
+  const cache_entry_t *hit;
+  cache_entry_t *e;
+
+  if (!parse_cache.entries || !main_ractor_p()) return addr_read(buf, len, addr);
+
+  if ((hit = cache_get(&parse_cache, buf, len))) {
+    *addr = hit->addr;
+    return addr->type;
+  }
+
+  addr_read(buf, len, addr);
+
+  if ((e = cache_put(&parse_cache, buf, len))) {
+    e->addr = *addr;
+  }
+  return addr->type;
+}
+
+/**
+ * @return a new Net4, Net6, IP4 or IP6 holding +addr+, nil for
+ * ADDR_NONE
+ */
+static VALUE
+addr_new(const addr_t *addr) {
+  switch (addr->type) {
+  case ADDR_NET4: return net4_new(Net4, addr->u.net4);
+  case ADDR_NET6: return net6_new(Net6, addr->u.net6);
+  case ADDR_IP4: return ip4_new(IP4, addr->u.ip4);
+  case ADDR_IP6: return ip6_new(IP6, addr->u.ip6);
+  default: return Qnil;
+  }
+}
+
 /**
  * Try parsing +str+ as Net4, Net6, IP4, IP6.
  *
+ * @example parse a field of a log line in place
+ *   line = '203.0.113.9 - - [10/Oct/2000:13:55:36 -0700] "GET / HTTP/1.0" 200'
+ *   Subnets.parse(line, 0, line.index(' ')) #=> #<Subnets::IP4 203.0.113.9>
+ *
+ * @overload parse(str, offset=0, len=str.bytesize-offset)
+ *   @param [String] str
+ *   @param [Integer] offset parse only the +len+ bytes of +str+ from
+ *     +offset+, without creating a substring
+ *   @param [Integer] len
  * @return [Net4, Net6, IP4, IP6]
  * @raise {ParseError}
+ * @raise [IndexError] if +offset+ and +len+ are not within +str+
  */
 VALUE
-method_subnets_parse(VALUE mod, VALUE str) {
-  const char *s;
-  str = StringValue(str);
-  s = StringValueCStr(str);
-  {
-    net4_t net;
-    if (read_net4_strict(s, &net)) return net4_new(Net4, net);
-  }
-  {
-    net6_t net;
-    if (read_net6_strict(s, &net)) return net6_new(Net6, net);
+method_subnets_parse(int argc, VALUE *argv, VALUE mod) {
+  VALUE str, offset, len;
+  const char *buf;
+  long n;
+  addr_t addr;
+
+  rb_scan_args(argc, argv, "12", &str, &offset, &len);
+  buf = str_slice(&str, offset, len, &n);
+  if (addr_read_cached(buf, n, &addr)) return addr_new(&addr);
+
+  raise_parse_error("{v4,v6}{net,ip}", buf, n);
+  return Qnil;
+}
+
+/**
+ * @return [Integer] the number of entries in the parse cache, zero
+ *   when it is disabled
+ */
+VALUE
+method_subnets_parse_cache_size(VALUE mod) {
+  return SIZET2NUM(cache_capacity(&parse_cache));
+}
+
+/**
+ * Enable a cache of the last +n+ (rounded up to a power of two)
+ * distinct strings parsed by {Subnets.parse}, {Subnets.include?},
+ * {Subnets.include_many?}, {Subnets::Set} and {Subnets::Table}, or
+ * disable it with zero.  Worthwhile when the same few addresses are
+ * parsed over and over, as in X-Forwarded-For headers.  Resizing
+ * empties the cache and resets its counters.
+ *
+ * @param n [Integer] the number of entries, default 0
+ */
+VALUE
+method_subnets_set_parse_cache_size(VALUE mod, VALUE n) {
+  long size = NUM2LONG(n);
+  check_main_ractor("parse_cache_size");
+  if (size < 0) {
+    rb_raise(rb_eArgError, "parse_cache_size must not be negative, was %ld", size);
   }
-  {
-    ip4_t ip;
-    if (read_ip4_strict(s, &ip)) return ip4_new(IP4, ip);
+  cache_free(&parse_cache);
+  if (cache_init(&parse_cache, size)) rb_memerror();
+  return n;
+}
+
+/**
+ * Build the Hash returned by the cache_stats methods.
+ */
+static VALUE
+cache_stats(const cache_t *cache) {
+  VALUE stats = rb_hash_new();
+  rb_hash_aset(stats, ID2SYM(rb_intern("size")), SIZET2NUM(cache_capacity(cache)));
+  rb_hash_aset(stats, ID2SYM(rb_intern("hits")), SIZET2NUM(cache->hits));
+  rb_hash_aset(stats, ID2SYM(rb_intern("misses")), SIZET2NUM(cache->misses));
+  return stats;
+}
+
+/**
+ * @return [Hash{Symbol => Integer}] the +:size+ of the parse cache
+ *   and its +:hits+ and +:misses+ since it was sized
+ */
+VALUE
+method_subnets_parse_cache_stats(VALUE mod) {
+  return cache_stats(&parse_cache);
+}
+
+/**
+ * Read an IP, Net, or a String that parses as one into +addr+.
+ *
+ * @return the type of address read, ADDR_NONE if +v+ is none of
+ * those
+ */
+static addr_type_t
+addr_of(VALUE v, addr_t *addr) {
+  if (CLASS_OF(v) == IP4) {
+    ip4_t *ip;
+    TypedData_Get_Struct(v, ip4_t, &ip4_type, ip);
+    addr->u.ip4 = *ip;
+    addr->type = ADDR_IP4;
+  } else if (CLASS_OF(v) == IP6) {
+    ip6_t *ip;
+    TypedData_Get_Struct(v, ip6_t, &ip6_type, ip);
+    addr->u.ip6 = *ip;
+    addr->type = ADDR_IP6;
+  } else if (CLASS_OF(v) == Net4) {
+    net4_t *net;
+    TypedData_Get_Struct(v, net4_t, &net4_type, net);
+    addr->u.net4 = *net;
+    addr->type = ADDR_NET4;
+  } else if (CLASS_OF(v) == Net6) {
+    net6_t *net;
+    TypedData_Get_Struct(v, net6_t, &net6_type, net);
+    addr->u.net6 = *net;
+    addr->type = ADDR_NET6;
+  } else if (RB_TYPE_P(v, T_STRING)) {
+    addr_read_cached(RSTRING_PTR(v), RSTRING_LEN(v), addr);
+  } else {
+    addr->type = ADDR_NONE;
   }
-  {
-    ip6_t ip;
-    if (read_ip6_strict(s, &ip)) return ip6_new(IP6, ip);
+
+  return addr->type;
+}
+
+/**
+ * Like addr_of, but anything other than an IP, Net or String is
+ * converted with +to_str+ as by +StringValue+.
+ */
+static addr_type_t
+addr_of_str(VALUE *v, addr_t *addr) {
+  if (!addr_of(*v, addr) && !RB_TYPE_P(*v, T_STRING)) {
+    StringValue(*v);
+    addr_of(*v, addr);
   }
+  return addr->type;
+}
 
-  raise_parse_error("{v4,v6}{net,ip}", s);
-  return Qnil;
+static int
+net4_include_addr_p(net4_t net, const addr_t *addr) {
+  if (addr->type == ADDR_IP4) return net4_include_p(net, addr->u.ip4);
+  if (addr->type == ADDR_NET4) return net4_include_net4_p(net, addr->u.net4);
+  return 0;
+}
+
+static int
+net6_include_addr_p(net6_t net, const addr_t *addr) {
+  if (addr->type == ADDR_IP6) return net6_include_p(net, addr->u.ip6);
+  if (addr->type == ADDR_NET6) return net6_include_net6_p(net, addr->u.net6);
+  return 0;
 }
 
+static int compiled_include_p(VALUE nets, VALUE v, const addr_t *addr);
+
 /**
  * Test if any element in +nets+ includes +v+. For array elements
  * +obj+ that are not Net4 or Net6, calls +obj#===(v)+ to test for
  * inclusion.
  *
+ * A frozen Array passed a second time is compiled, as by
+ * {Subnets::Set.new} of its Net4 and Net6 elements, and the compiled
+ * form reused while the Array lives, so passing the same frozen list
+ * on every call costs one lookup in the set rather than a test of
+ * each element.  The call that compiles it costs several times a
+ * plain test, so this pays off only for lists kept and passed again,
+ * such as constants.
+ *
  * @see Subnets::IP4#include?
  * @see Subnets::IP6#include?
  * @param [Array<Net,Object>] nets
@@ -935,74 +1360,25 @@ method_subnets_parse(VALUE mod, VALUE str) {
  */
 VALUE
 method_subnets_include_p(VALUE self, VALUE nets, VALUE v) {
-  int is_net4 = 0, is_net6 = 0, is_ip4 = 0, is_ip6 = 0;
-  net4_t net4;
-  net6_t net6;
-  ip4_t ip4;
-  ip6_t ip6;
+  addr_t addr;
 
-  if (CLASS_OF(v) == IP4) {
-    ip4_t *_ip4;
-    is_ip4 = !0;
-    Data_Get_Struct(v, ip4_t, _ip4);
-    ip4 = *_ip4;
-  } else if (CLASS_OF(v) == IP6) {
-    ip6_t *_ip6;
-    is_ip6 = !0;
-    Data_Get_Struct(v, ip6_t, _ip6);
-    ip6 = *_ip6;
-  } else if (CLASS_OF(v) == Net4) {
-    net4_t *_net4;
-    is_net4 = !0;
-    Data_Get_Struct(v, net4_t, _net4);
-    net4 = *_net4;
-  } else if (CLASS_OF(v) == Net6) {
-    net6_t *_net6;
-    is_net6 = !0;
-    Data_Get_Struct(v, net6_t, _net6);
-    net6 = *_net6;
-  } else {
-    const char *buf = StringValueCStr(v);
+  addr_of_str(&v, &addr);
 
-    if (read_net4_strict(buf, &net4)) is_net4 = !0;
-    else if (read_net6_strict(buf, &net6)) is_net6 = !0;
-    else if (read_ip4_strict(buf, &ip4)) is_ip4 = !0;
-    else if (read_ip6_strict(buf, &ip6)) is_ip6 = !0;
+  if (RB_TYPE_P(nets, T_ARRAY) && RB_OBJ_FROZEN(nets) && main_ractor_p()) {
+    int ret = compiled_include_p(nets, v, &addr);
+    if (ret >= 0) return ret ? Qtrue : Qfalse;
   }
 
   for (ssize_t i = 0; i < RARRAY_LEN(nets); i++) {
     VALUE rbnet = RARRAY_AREF(nets, i);
+    VALUE class = CLASS_OF(rbnet);
 
-    if (CLASS_OF(rbnet) == Net4) {
-      if (is_net4) {
-        net4_t *net;
-        Data_Get_Struct(rbnet, net4_t, net);
-        if (net4_include_net4_p(*net, net4)) {
-          return Qtrue;
-        }
-      } else if (is_ip4) {
-        net4_t *net;
-        Data_Get_Struct(rbnet, net4_t, net);
-        if (net4_include_p(*net, ip4)) {
-          return Qtrue;
-        }
-      }
+    if (class == Net4) {
+      if (net4_include_addr_p(*(const net4_t *) VALUE_DATA(rbnet), &addr)) return Qtrue;
     }
 
-    else if (CLASS_OF(rbnet) == Net6) {
-      if (is_net6) {
-        net6_t *net;
-        Data_Get_Struct(rbnet, net6_t, net);
-        if (net6_include_net6_p(*net, net6)) {
-          return Qtrue;
-        }
-      } else if (is_ip6) {
-        net6_t *net;
-        Data_Get_Struct(rbnet, net6_t, net);
-        if (net6_include_p(*net, ip6)) {
-          return Qtrue;
-        }
-      }
+    else if (class == Net6) {
+      if (net6_include_addr_p(*(const net6_t *) VALUE_DATA(rbnet), &addr)) return Qtrue;
     }
 
     else {
@@ -1014,52 +1390,2035 @@ method_subnets_include_p(VALUE self, VALUE nets, VALUE v) {
   return Qfalse;
 }
 
-VALUE
-method_ip_inspect(VALUE ip) {
-  VALUE fmt = rb_str_new_cstr("#<%s %s>");
-  VALUE args = rb_ary_new_from_args(2,
-                                    rb_funcall(ip, rb_intern("class"), 0),
-                                    rb_funcall(ip, rb_intern("to_s"), 0));
-  return rb_funcall(fmt, rb_intern("%"), 1, args);
-}
-
-VALUE
-method_net_inspect(VALUE net) {
-  VALUE fmt = rb_str_new_cstr("#<%s address=%s prefixlen=%d mask=%s>");
-  VALUE args = rb_ary_new_from_args(4,
-                                    rb_funcall(net, rb_intern("class"), 0),
-                                    rb_funcall(net, rb_intern("address"), 0),
-                                    rb_funcall(net, rb_intern("prefixlen"), 0),
-                                    rb_funcall(net, rb_intern("mask"), 0));
-  return rb_funcall(fmt, rb_intern("%"), 1, args);
-}
-
 /**
+ * Test each element of +ips+ as by {Subnets.include?}.  The networks
+ * in +nets+ are read once for the whole batch.
  *
+ * @param [Array<Net,Object>] nets
+ * @param [Array<String, IP, Net>] ips
+ * @return [Array<Boolean>] whether +nets+ includes each element of +ips+
  */
-void Init_Subnets() {
-  rb_intern_hash = rb_intern("hash");
-  rb_intern_xor = rb_intern("^");
-  
-  // Subnets
-  Subnets = rb_define_module("Subnets");
-  rb_define_singleton_method(Subnets, "parse", method_subnets_parse, 1);
-  rb_define_singleton_method(Subnets, "include?", method_subnets_include_p, 2);
+VALUE
+method_subnets_include_many_p(VALUE self, VALUE nets, VALUE ips) {
+  net4_t *net4s;
+  net6_t *net6s;
+  long n4 = 0, n6 = 0;
+  VALUE others = rb_ary_new();
+  VALUE buf4, buf6, result;
 
-  // Subnets::ParseError
-  ParseError = rb_define_class_under(Subnets, "ParseError", rb_eArgError);
+  Check_Type(nets, T_ARRAY);
+  Check_Type(ips, T_ARRAY);
 
-  // Subnets::IP
-  IP = rb_define_class_under(Subnets, "IP", rb_cObject);
-  rb_define_method(IP, "inspect", method_ip_inspect, 0);
+  net4s = ALLOCV_N(net4_t, buf4, RARRAY_LEN(nets));
+  net6s = ALLOCV_N(net6_t, buf6, RARRAY_LEN(nets));
 
-  // Subnets::IP4
-  IP4 = rb_define_class_under(Subnets, "IP4", IP);
-  rb_define_singleton_method(IP4, "random", method_ip4_random, -1);
-  rb_define_singleton_method(IP4, "new", method_ip4_new, 1);
-  rb_define_method(IP4, "==", method_ip4_eql_p, 1);
-  rb_define_alias(IP4, "eql?", "==");
-  rb_define_method(IP4, "hash", method_ip4_hash, 0);
+  for (ssize_t i = 0; i < RARRAY_LEN(nets); i++) {
+    VALUE rbnet = RARRAY_AREF(nets, i);
+
+    if (CLASS_OF(rbnet) == Net4) {
+      net4_t *net;
+      TypedData_Get_Struct(rbnet, net4_t, &net4_type, net);
+      net4s[n4++] = *net;
+    } else if (CLASS_OF(rbnet) == Net6) {
+      net6_t *net;
+      TypedData_Get_Struct(rbnet, net6_t, &net6_type, net);
+      net6s[n6++] = *net;
+    } else {
+      rb_ary_push(others, rbnet);
+    }
+  }
+
+  result = rb_ary_new_capa(RARRAY_LEN(ips));
+
+  for (ssize_t i = 0; i < RARRAY_LEN(ips); i++) {
+    VALUE v = RARRAY_AREF(ips, i);
+    VALUE found = Qfalse;
+    addr_t addr;
+
+    switch (addr_of_str(&v, &addr)) {
+    case ADDR_IP4:
+    case ADDR_NET4:
+      for (long j = 0; j < n4; j++) {
+        if (net4_include_addr_p(net4s[j], &addr)) { found = Qtrue; break; }
+      }
+      break;
+    case ADDR_IP6:
+    case ADDR_NET6:
+      for (long j = 0; j < n6; j++) {
+        if (net6_include_addr_p(net6s[j], &addr)) { found = Qtrue; break; }
+      }
+      break;
+    default:
+      break;
+    }
+
+    for (ssize_t j = 0; !RTEST(found) && j < RARRAY_LEN(others); j++) {
+      if (RTEST(rb_funcall(RARRAY_AREF(others, j), rb_intern("==="), 1, v))) found = Qtrue;
+    }
+
+    rb_ary_push(result, found);
+  }
+
+  ALLOCV_END(buf4);
+  ALLOCV_END(buf6);
+
+  return result;
+}
+
+/**
+ * Extract the trie key and prefixlen of an address.  IPs have the
+ * prefixlen of a single address.
+ *
+ * @return 4 or 6 for the address family, or 0 for ADDR_NONE
+ */
+static int
+trie_key_of_addr(const addr_t *addr, trie_key_t *key, int *prefixlen) {
+  switch (addr->type) {
+  case ADDR_IP4:
+    *key = trie_key_from_ip4(addr->u.ip4);
+    *prefixlen = 32;
+    return 4;
+  case ADDR_IP6:
+    *key = trie_key_from_ip6(addr->u.ip6);
+    *prefixlen = 128;
+    return 6;
+  case ADDR_NET4:
+    *key = trie_key_from_ip4(addr->u.net4.address);
+    *prefixlen = addr->u.net4.prefixlen;
+    return 4;
+  case ADDR_NET6:
+    *key = trie_key_from_ip6(addr->u.net6.address);
+    *prefixlen = addr->u.net6.prefixlen;
+    return 6;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Extract the trie key and prefixlen of an IP, Net, or a String that
+ * parses as one.
+ *
+ * @return 4 or 6 for the address family, or 0 if +v+ is not an IP or
+ * Net
+ */
+static int
+trie_key_of(VALUE v, trie_key_t *key, int *prefixlen) {
+  addr_t addr;
+  addr_of(v, &addr);
+  return trie_key_of_addr(&addr, key, prefixlen);
+}
+
+/**
+ * Raise the error for a value rejected by trie_key_of().
+ */
+static void
+raise_key_error(VALUE v) {
+  if (RB_TYPE_P(v, T_STRING)) {
+    raise_parse_error("{v4,v6}{net,ip}", RSTRING_PTR(v), RSTRING_LEN(v));
+  }
+  rb_raise(rb_eTypeError, "wrong argument type %s (expected Net4, Net6, IP4, IP6 or String)",
+           rb_obj_classname(v));
+}
+
+/**
+ * Aggregate +nets+ into the shortest list of networks that includes
+ * exactly the same addresses: networks included in others are
+ * dropped, and pairs of adjacent networks that together make up a
+ * larger network are replaced by it, repeatedly.
+ *
+ *   Subnets.aggregate(%w(10.0.0.0/25 10.0.0.128/25 10.0.0.7 ::1))
+ *   #=> [#<Subnets::Net4 10.0.0.0/24>, #<Subnets::Net6 ::1/128>]
+ *
+ * @param nets [Array<Net4, Net6, IP4, IP6, String>] networks; IPs
+ *   are taken as single-address networks and Strings are parsed as by
+ *   {Subnets.parse}
+ * @return [Array<Net4, Net6>] the Net4s sorted by address, then the
+ *   Net6s sorted by address
+ * @raise {Subnets::ParseError}
+ */
+VALUE
+method_subnets_aggregate(VALUE self, VALUE nets) {
+  prefix_t *v4s, *v6s;
+  size_t n4 = 0, n6 = 0;
+  VALUE buf4, buf6, result;
+
+  Check_Type(nets, T_ARRAY);
+
+  v4s = ALLOCV_N(prefix_t, buf4, RARRAY_LEN(nets));
+  v6s = ALLOCV_N(prefix_t, buf6, RARRAY_LEN(nets));
+
+  for (ssize_t i = 0; i < RARRAY_LEN(nets); i++) {
+    VALUE v = RARRAY_AREF(nets, i);
+    trie_key_t key;
+    int prefixlen;
+
+    switch (trie_key_of(v, &key, &prefixlen)) {
+    case 4:
+      v4s[n4].key = key;
+      v4s[n4++].prefixlen = prefixlen;
+      break;
+    case 6:
+      v6s[n6].key = key;
+      v6s[n6++].prefixlen = prefixlen;
+      break;
+    default:
+      raise_key_error(v);
+    }
+  }
+
+  n4 = aggregate(v4s, n4);
+  n6 = aggregate(v6s, n6);
+
+  result = rb_ary_new_capa(n4 + n6);
+  for (size_t i = 0; i < n4; i++) {
+    net4_t net;
+    net.address = trie_key_to_ip4(v4s[i].key);
+    net.prefixlen = v4s[i].prefixlen;
+    net.mask = mk_mask4(net.prefixlen);
+    rb_ary_push(result, net4_new(Net4, net));
+  }
+  for (size_t i = 0; i < n6; i++) {
+    net6_t net;
+    net.address = trie_key_to_ip6(v6s[i].key);
+    net.prefixlen = v6s[i].prefixlen;
+    net.mask = mk_mask6(net.prefixlen);
+    rb_ary_push(result, net6_new(Net6, net));
+  }
+
+  ALLOCV_END(buf4);
+  ALLOCV_END(buf6);
+
+  return result;
+}
+
+/**
+ * Sort +ips+, all IP4s, IP6s, Net4s or Net6s, in the order of their
+ * {Subnets::IP4#<=> <=>}, with a radix sort of their raw addresses
+ * rather than calls to +<=>+.  Equal elements keep their order.
+ *
+ * @param ips [Array<IP4>, Array<IP6>, Array<Net4>, Array<Net6>]
+ * @return [Array] a new Array of the elements of +ips+
+ * @raise [TypeError] if the elements are not IPs or nets
+ * @raise [ArgumentError] if the elements are of more than one class
+ */
+VALUE
+method_subnets_sort(VALUE self, VALUE ips) {
+  sort_item_t *items;
+  long n;
+  VALUE buf, class, result;
+  int keybits, nets;
+
+  Check_Type(ips, T_ARRAY);
+  if ((n = RARRAY_LEN(ips)) == 0) return rb_ary_new();
+
+  class = CLASS_OF(RARRAY_AREF(ips, 0));
+  if (class == IP4 || class == Net4) {
+    keybits = 32;
+  } else if (class == IP6 || class == Net6) {
+    keybits = 128;
+  } else {
+    rb_raise(rb_eTypeError, "wrong argument type %s (expected IP4, IP6, Net4 or Net6)",
+             rb_obj_classname(RARRAY_AREF(ips, 0)));
+  }
+  nets = class == Net4 || class == Net6;
+
+  items = ALLOCV_N(sort_item_t, buf, n);
+  for (long i = 0; i < n; i++) {
+    VALUE v = RARRAY_AREF(ips, i);
+
+    if (CLASS_OF(v) != class) {
+      rb_raise(rb_eArgError, "comparison of %"PRIsVALUE" with %s failed", class, rb_obj_classname(v));
+    }
+
+    items[i].index = i;
+    if (class == IP4) {
+      items[i].key = trie_key_from_ip4(*(const ip4_t *) VALUE_DATA(v));
+      items[i].prefixlen = 32;
+    } else if (class == IP6) {
+      items[i].key = trie_key_from_ip6(*(const ip6_t *) VALUE_DATA(v));
+      items[i].prefixlen = 128;
+    } else if (class == Net4) {
+      const net4_t *net = VALUE_DATA(v);
+      items[i].key = trie_key_from_ip4(net->address);
+      items[i].prefixlen = net->prefixlen;
+    } else {
+      const net6_t *net = VALUE_DATA(v);
+      items[i].key = trie_key_from_ip6(net->address);
+      items[i].prefixlen = net->prefixlen;
+    }
+  }
+
+  if (radix_sort(items, n, keybits, nets)) {
+    ALLOCV_END(buf);
+    rb_memerror();
+  }
+
+  result = rb_ary_new_capa(n);
+  for (long i = 0; i < n; i++) {
+    rb_ary_push(result, RARRAY_AREF(ips, items[i].index));
+  }
+  ALLOCV_END(buf);
+
+  return result;
+}
+
+/**
+ * A Set is a compiled, immutable collection of Net4 and Net6
+ * networks held in a pair of path-compressed binary tries, one per
+ * address family, so that membership tests take time proportional to
+ * the prefix length rather than the number of networks.  With the
+ * :dir24_8 engine, IPv4 lookups are answered by a DIR-24-8 table
+ * instead of the trie.  Strings looked up in a set may be cached
+ * along with the result; the cache is only touched with the GVL held.
+ * A set loaded by Set.mmap points its tries and table into the
+ * mapped image rather than owning them.  A set of at most
+ * SET_SMALL_MAX networks also copies them into a netlist, which is
+ * searched instead of the tries and table.
+ */
+typedef struct {
+  trie_t v4;
+  trie_t v6;
+  dir24_t *dir24;
+  netlist_t *small;             /* NULL unless few networks */
+  cache_t cache;
+  image_t image;                /* base is NULL unless mapped */
+  size_t gc_memsize;            /* reported to rb_gc_adjust_memory_usage */
+} set_t;
+
+static void
+set_free(void *p) {
+  set_t *set = p;
+  if (set->image.base) {
+    image_unmap(&set->image);
+  } else {
+    trie_free(&set->v4);
+    trie_free(&set->v6);
+    if (set->dir24) {
+      dir24_free(set->dir24);
+      free(set->dir24);
+    }
+  }
+  if (set->small) {
+    netlist_free(set->small);
+    free(set->small);
+  }
+  cache_free(&set->cache);
+  rb_gc_adjust_memory_usage(-(ssize_t) set->gc_memsize);
+  xfree(set);
+}
+
+/* a mapped image is backed by its file, so is not counted */
+static size_t
+set_memsize(const void *p) {
+  const set_t *set = p;
+  size_t size = sizeof(set_t) + cache_memsize(&set->cache) +
+    (set->small ? sizeof(netlist_t) + netlist_memsize(set->small) : 0);
+  if (set->image.base) return size;
+  return size + trie_memsize(&set->v4) + trie_memsize(&set->v6) +
+    (set->dir24 ? sizeof(dir24_t) + dir24_memsize(set->dir24) : 0);
+}
+
+/*
+ * Sets are frozen from the start.  Those without a cache are never
+ * written after they are built, so may be shared between Ractors;
+ * those with one have their own type, set_cached_type, as lookups
+ * write to the cache.
+ */
+static const rb_data_type_t set_type = {
+  "Subnets::Set",
+  { 0, set_free, set_memsize, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY | SUBNETS_TYPED_SHAREABLE,
+};
+
+static const rb_data_type_t set_cached_type = {
+  "Subnets::Set",
+  { 0, set_free, set_memsize, },
+  &set_type, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+/**
+ * Allocate a frozen set of +class+ that has a cache of +cachesize+.
+ */
+static VALUE
+set_alloc(VALUE class, long cachesize, set_t **setp) {
+  VALUE rbset = TypedData_Make_Struct(class, set_t, cachesize ? &set_cached_type : &set_type, *setp);
+  RB_OBJ_FREEZE(rbset);
+  return rbset;
+}
+
+#ifdef SUBNETS_DIR24_8
+#define SET_DEFAULT_ENGINE "dir24_8"
+#else
+#define SET_DEFAULT_ENGINE "trie"
+#endif
+
+static void
+set_insert4(set_t *set, ip4_t address, int prefixlen) {
+  if (trie_insert(&set->v4, trie_key_from_ip4(address), prefixlen, 1)) rb_memerror();
+  if (set->dir24 && dir24_insert(set->dir24, address, prefixlen)) rb_memerror();
+}
+
+static void
+set_insert6(set_t *set, trie_key_t key, int prefixlen) {
+  if (trie_insert(&set->v6, key, prefixlen, 1)) rb_memerror();
+}
+
+/* most networks a set holds in a netlist; beyond that, tries win */
+#define SET_SMALL_MAX 128
+
+static int
+set_match4(const set_t *set, ip4_t ip, int prefixlen) {
+  if (set->small) return netlist_match4(set->small, ip, prefixlen);
+  if (set->dir24) return dir24_match(set->dir24, ip, prefixlen);
+  return trie_match_any(&set->v4, trie_key_from_ip4(ip), prefixlen) != NULL;
+}
+
+static int
+set_include_addr_p(const set_t *set, const addr_t *addr) {
+  trie_key_t key;
+  int prefixlen;
+
+  switch (trie_key_of_addr(addr, &key, &prefixlen)) {
+  case 4: return set_match4(set, trie_key_to_ip4(key), prefixlen);
+  case 6:
+    if (set->small) return netlist_match6(set->small, trie_key_to_ip6(key), prefixlen);
+    return trie_match_any(&set->v6, key, prefixlen) != NULL;
+  default: return 0;
+  }
+}
+
+/**
+ * Test if this set includes the String +str+, through the set's
+ * cache of results.
+ */
+static int
+set_include_str_p(set_t *set, VALUE str) {
+  const cache_entry_t *hit;
+  cache_entry_t *e;
+  addr_t addr;
+  int found;
+
+  if ((hit = cache_get(&set->cache, RSTRING_PTR(str), RSTRING_LEN(str)))) {
+    return hit->value;
+  }
+
+  addr_read_cached(RSTRING_PTR(str), RSTRING_LEN(str), &addr);
+  found = set_include_addr_p(set, &addr);
+
+  if ((e = cache_put(&set->cache, RSTRING_PTR(str), RSTRING_LEN(str)))) {
+    e->addr = addr;
+    e->value = found;
+  }
+  return found;
+}
+
+/**
+ * Test if this set includes +v+, as by addr_of().
+ */
+static int
+set_include_p(set_t *set, VALUE v) {
+  addr_t addr;
+
+  if (RB_TYPE_P(v, T_STRING)) return set_include_str_p(set, v);
+  addr_of(v, &addr);
+  return set_include_addr_p(set, &addr);
+}
+
+static void
+set_add(set_t *set, VALUE v) {
+  trie_key_t key;
+  int prefixlen;
+
+  switch (trie_key_of(v, &key, &prefixlen)) {
+  case 4:
+    set_insert4(set, trie_key_to_ip4(key), prefixlen);
+    break;
+  case 6:
+    set_insert6(set, key, prefixlen);
+    break;
+  default:
+    raise_key_error(v);
+  }
+}
+
+/**
+ * Make an empty set of +class+ with the +engine+ and +cache+ given in
+ * +opts+, as taken by {Set.new}.
+ */
+static VALUE
+set_make(VALUE class, VALUE opts, set_t **setp) {
+  set_t *set;
+  VALUE rbset, engine = Qnil, cache = Qnil;
+  long cachesize = 0;
+
+  if (Qnil != opts) {
+    engine = rb_hash_aref(opts, ID2SYM(rb_intern("engine")));
+    cache = rb_hash_aref(opts, ID2SYM(rb_intern("cache")));
+  }
+  if (Qnil != cache && (cachesize = NUM2LONG(cache)) < 0) {
+    rb_raise(rb_eArgError, "cache must not be negative, was %ld", cachesize);
+  }
+  if (Qnil == engine) {
+    engine = ID2SYM(rb_intern(SET_DEFAULT_ENGINE));
+  }
+  if (engine != ID2SYM(rb_intern("trie")) && engine != ID2SYM(rb_intern("dir24_8"))) {
+    rb_raise(rb_eArgError, "unknown engine %"PRIsVALUE" (expected :trie or :dir24_8)", engine);
+  }
+
+  rbset = set_alloc(class, cachesize, &set);
+  if (trie_init(&set->v4, 32) || trie_init(&set->v6, 128)) {
+    rb_memerror();
+  }
+  if (engine == ID2SYM(rb_intern("dir24_8"))) {
+    if (!(set->dir24 = malloc(sizeof(dir24_t)))) rb_memerror();
+    if (dir24_init(set->dir24)) {
+      free(set->dir24);
+      set->dir24 = NULL;
+      rb_memerror();
+    }
+  }
+  if (cache_init(&set->cache, cachesize)) rb_memerror();
+
+  *setp = set;
+  return rbset;
+}
+
+static int
+set_small_add4(const trie_node_t *node, void *list) {
+  return netlist_add4(list, trie_key_to_ip4(node->key), node->prefixlen);
+}
+
+static int
+set_small_add6(const trie_node_t *node, void *list) {
+  return netlist_add6(list, trie_key_to_ip6(node->key), node->prefixlen);
+}
+
+/**
+ * Copy the networks of a set of at most SET_SMALL_MAX into a netlist
+ * and report the memory of the set, once all its networks are added.
+ * The matchers compare whole blocks, so the netlist is only used once
+ * the walk has filled exactly the counted entries; a set whose counts
+ * do not match its tries is left to its tries.
+ */
+static void
+set_built(set_t *set) {
+  if (set->v4.count + set->v6.count <= SET_SMALL_MAX) {
+    netlist_t *small = malloc(sizeof(netlist_t));
+    if (!small || netlist_init(small, set->v4.count, set->v6.count)) {
+      free(small);
+      rb_memerror();
+    }
+    if (trie_walk(&set->v4, set_small_add4, small) ||
+        trie_walk(&set->v6, set_small_add6, small) ||
+        small->n4 != set->v4.count || small->n6 != set->v6.count) {
+      netlist_free(small);
+      free(small);
+    } else {
+      set->small = small;
+    }
+  }
+  set->gc_memsize = set_memsize(set);
+  rb_gc_adjust_memory_usage(set->gc_memsize);
+}
+
+/**
+ * Compile +nets+ into a set of +class+, as by {Set.new}.
+ */
+static VALUE
+set_new(VALUE class, VALUE nets, VALUE opts) {
+  set_t *set;
+  VALUE rbset;
+
+  Check_Type(nets, T_ARRAY);
+
+  rbset = set_make(class, opts, &set);
+  for (ssize_t i = 0; i < RARRAY_LEN(nets); i++) {
+    set_add(set, RARRAY_AREF(nets, i));
+  }
+  set_built(set);
+
+  return rbset;
+}
+
+/*
+ * Frozen arrays passed to Subnets.include? are compiled into a Set of
+ * their Net4 and Net6 elements and a list of the other elements, to
+ * be tested with ===.  Compiling costs about ten times a plain test of
+ * each element, so an array is only compiled once it is seen again:
+ * a small two-way set-associative filter remembers the identities of
+ * the arrays seen last, without holding them, and an array frozen
+ * for a single call is never compiled.
+ *
+ * Compiled arrays are kept in a Hash keyed by object_id, which is
+ * never reused, so a frozen array, which cannot change, is found
+ * without comparing its elements.  A WeakMap from the same ids to
+ * the arrays forgets each array once it is collected, and the first
+ * lookup after every GC drops the compiled forms of such arrays, so
+ * the cache holds no array alive.  Only the main Ractor uses it.
+ */
+#define COMPILED_BITS 7
+
+/* two ways of identities, not marked; a collected array just misses */
+static VALUE compiled_seen[1 << COMPILED_BITS][2];
+
+static VALUE compiled_ids = Qnil;     /* object_id => [set, others] */
+static VALUE compiled_arrays = Qnil;  /* WeakMap of object_id => array */
+static size_t compiled_gc_count;
+
+static int
+compiled_prune_i(VALUE id, VALUE entry, VALUE arg) {
+  return RTEST(rb_funcall(compiled_arrays, rb_intern("key?"), 1, id)) ? ST_CONTINUE : ST_DELETE;
+}
+
+/* drop the compiled forms of arrays collected since the last GC */
+static void
+compiled_prune(void) {
+  size_t count = rb_gc_count();
+
+  if (count == compiled_gc_count) return;
+  compiled_gc_count = count;
+  rb_hash_foreach(compiled_ids, compiled_prune_i, 0);
+}
+
+/* the Set and list of other elements of nets */
+static VALUE
+compiled_new(VALUE nets) {
+  VALUE rbset, others, opts;
+  set_t *set;
+
+  opts = rb_hash_new();
+  rb_hash_aset(opts, ID2SYM(rb_intern("engine")), ID2SYM(rb_intern("trie")));
+  rbset = set_make(Set, opts, &set);
+  others = rb_obj_hide(rb_ary_new());
+
+  for (long i = 0; i < RARRAY_LEN(nets); i++) {
+    VALUE rbnet = RARRAY_AREF(nets, i);
+    VALUE class = CLASS_OF(rbnet);
+
+    if (class == Net4) {
+      const net4_t *net = VALUE_DATA(rbnet);
+      set_insert4(set, net->address, net->prefixlen);
+    } else if (class == Net6) {
+      const net6_t *net = VALUE_DATA(rbnet);
+      set_insert6(set, trie_key_from_ip6(net->address), net->prefixlen);
+    } else {
+      rb_ary_push(others, rbnet);
+    }
+  }
+  set_built(set);
+
+  return rb_obj_hide(rb_ary_new_from_args(2, rbset, others));
+}
+
+/**
+ * Find the compiled form of the frozen Array +nets+, compiling it if
+ * it was seen lately.
+ *
+ * @return a hidden Array of the Set and the other elements, or nil if
+ *   +nets+ is not compiled yet
+ */
+static VALUE
+compiled_get(VALUE nets) {
+  uint64_t h = (uint64_t) (nets >> 3) * 0x9e3779b97f4a7c15ULL;
+  VALUE *seen = compiled_seen[h >> (64 - COMPILED_BITS)];
+  VALUE id, entry;
+
+  if (seen[0] != nets && seen[1] != nets) {
+    /* the older way makes room */
+    seen[1] = seen[0];
+    seen[0] = nets;
+    return Qnil;
+  }
+
+  compiled_prune();
+  id = rb_obj_id(nets);
+  if (NIL_P(entry = rb_hash_lookup(compiled_ids, id))) {
+    entry = compiled_new(nets);
+    rb_hash_aset(compiled_ids, id, entry);
+    rb_funcall(compiled_arrays, rb_intern("[]="), 2, id, nets);
+  }
+  return entry;
+}
+
+/**
+ * Test if the frozen Array +nets+ includes +v+, read into +addr+, as
+ * by Subnets.include?, through its compiled form.  The compiled form
+ * is held on the stack, since === may call Subnets.include? and drop
+ * it from the cache.
+ *
+ * @return 1 or 0, or -1 if +nets+ is not compiled yet
+ */
+static int
+compiled_include_p(VALUE nets, VALUE v, const addr_t *addr) {
+  VALUE entry = compiled_get(nets);
+  const set_t *set;
+  VALUE rbset, others;
+
+  if (NIL_P(entry)) return -1;
+  rbset = RARRAY_AREF(entry, 0);
+  others = RARRAY_AREF(entry, 1);
+  TypedData_Get_Struct(rbset, set_t, &set_type, set);
+
+  if (set_include_addr_p(set, addr)) return 1;
+  for (long i = 0; i < RARRAY_LEN(others); i++) {
+    if (RTEST(rb_funcall(RARRAY_AREF(others, i), rb_intern("==="), 1, v))) return 1;
+  }
+  RB_GC_GUARD(rbset);
+  RB_GC_GUARD(others);
+  return 0;
+}
+
+/**
+ * Compile +nets+ into a Set.
+ *
+ * The :trie engine holds IPv4 networks in a prefix trie like IPv6
+ * networks.  The :dir24_8 engine additionally builds a DIR-24-8 table
+ * of IPv4 networks, trading 64 MB or more of memory (see {#memsize})
+ * for lookups in at most two memory accesses.  The default engine is
+ * :trie unless the extension was built with +--enable-dir24-8+.
+ *
+ * With +cache+, the set remembers whether it includes each of the
+ * last +cache+ (rounded up to a power of two) distinct Strings
+ * looked up in it.  See {#cache_stats}.
+ *
+ * @overload new(nets, engine: :trie, cache: 0)
+ *   @param nets [Array<Net4, Net6, IP4, IP6, String>] networks; IPs
+ *     are added as single-address networks and Strings are parsed as
+ *     by {Subnets.parse}
+ *   @param engine [Symbol] :trie or :dir24_8
+ *   @param cache [Integer] the number of lookup results to cache
+ * @return [Set]
+ * @raise {Subnets::ParseError}
+ */
+VALUE
+method_set_new(int argc, VALUE *argv, VALUE class) {
+  VALUE nets, opts;
+
+  rb_scan_args(argc, argv, "1:", &nets, &opts);
+  return set_new(class, nets, opts);
+}
+
+/*
+ * Set.load reads its source LOAD_CHUNK bytes at a time into one
+ * reused String and adds the network on each line straight from the
+ * buffer.  A line split across chunks is carried over in
+ * set_loader_t, less its leading whitespace and anything after its
+ * first word; a word longer than LOAD_LINE_MAX bytes, far more than
+ * any network, is rejected rather than cut.
+ */
+#define LOAD_CHUNK 65536
+#define LOAD_LINE_MAX 256
+
+typedef struct {
+  set_t *set;
+  VALUE io;
+  VALUE buf;
+  long lineno;
+  size_t len;                   /* bytes of a partial line in line */
+  int done;                     /* line holds the whole first word */
+  char line[LOAD_LINE_MAX];
+} set_loader_t;
+
+static int
+load_space_p(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+/**
+ * Add the network on the line +p+ to +end+, if it is not blank or a
+ * comment.  The network is the first word of the line; anything after
+ * it is ignored.
+ */
+static void
+set_load_line(set_loader_t *loader, const char *p, const char *end) {
+  const char *word;
+  trie_key_t key;
+  int prefixlen;
+  addr_t addr;
+
+  loader->lineno++;
+  while (p < end && load_space_p(*p)) p++;
+  if (p == end || *p == '#' || *p == ';') return;
+
+  word = p;
+  while (p < end && !load_space_p(*p) && *p != '#' && *p != ';') p++;
+
+  read_any_strict_n(word, p - word, &addr);
+  switch (trie_key_of_addr(&addr, &key, &prefixlen)) {
+  case 4:
+    set_insert4(loader->set, trie_key_to_ip4(key), prefixlen);
+    break;
+  case 6:
+    set_insert6(loader->set, key, prefixlen);
+    break;
+  default:
+    if (p - word > 49) {
+      rb_raise(ParseError, "line %ld: failed to parse as IP or net: '%.45s...'", loader->lineno, word);
+    }
+    rb_raise(ParseError, "line %ld: failed to parse as IP or net: '%.*s'",
+             loader->lineno, (int) (p - word), word);
+  }
+}
+
+/*
+ * Keep the first word of a partial line, up to and including the byte
+ * that ends it, until the rest of the line is read.
+ */
+static void
+set_load_carry(set_loader_t *loader, const char *p, size_t n) {
+  const char *end = p + n;
+
+  if (loader->done) return;
+  if (!loader->len) {
+    while (p < end && load_space_p(*p)) p++;
+  }
+  for (; p < end; p++) {
+    if (loader->len == LOAD_LINE_MAX) {
+      rb_raise(ParseError, "line %ld: failed to parse as IP or net: '%.45s...'",
+               loader->lineno + 1, loader->line);
+    }
+    loader->line[loader->len++] = *p;
+    if (load_space_p(*p) || *p == '#' || *p == ';') {
+      loader->done = 1;
+      return;
+    }
+  }
+}
+
+static void
+set_load_chunk(set_loader_t *loader, const char *p, const char *end) {
+  const char *nl;
+
+  while ((nl = memchr(p, '\n', end - p))) {
+    if (loader->len) {
+      set_load_carry(loader, p, nl - p);
+      set_load_line(loader, loader->line, loader->line + loader->len);
+      loader->len = 0;
+      loader->done = 0;
+    } else {
+      set_load_line(loader, p, nl);
+    }
+    p = nl + 1;
+  }
+  set_load_carry(loader, p, end - p);
+}
+
+/*
+ * Read the source until it returns nil or an empty String, parsing
+ * what each read returns, which need not be the buffer passed in.
+ */
+static VALUE
+set_load_io(VALUE arg) {
+  set_loader_t *loader = (set_loader_t *) arg;
+  ID read = rb_intern("read");
+  VALUE chunk;
+
+  while (!NIL_P(chunk = rb_funcall(loader->io, read, 2, INT2FIX(LOAD_CHUNK), loader->buf))) {
+    StringValue(chunk);
+    if (!RSTRING_LEN(chunk)) break;
+    set_load_chunk(loader, RSTRING_PTR(chunk), RSTRING_END(chunk));
+    RB_GC_GUARD(chunk);
+  }
+  if (loader->len) set_load_line(loader, loader->line, loader->line + loader->len);
+  return Qnil;
+}
+
+/**
+ * Compile the networks listed in +source+, one per line, into a Set
+ * without making a String or Net for each line.  The network is the
+ * first word of each line, parsed as by {Subnets.parse}; the rest of
+ * the line is ignored, as are blank lines and lines starting with
+ * +#+ or +;+.
+ *
+ * @overload load(source, engine: :trie, cache: 0)
+ *   @param source [IO, String, Pathname] an IO, or anything whose
+ *     +read(length, buffer)+ returns the next String or nil like
+ *     one, or the path of a file
+ *   @param engine [Symbol] as for {Set.new}
+ *   @param cache [Integer] as for {Set.new}
+ * @return [Set]
+ * @raise {Subnets::ParseError} naming the line number of the first
+ *   line that could not be parsed
+ */
+VALUE
+method_set_load(int argc, VALUE *argv, VALUE class) {
+  set_loader_t loader;
+  VALUE rbset, source, opts;
+
+  rb_scan_args(argc, argv, "1:", &source, &opts);
+
+  rbset = set_make(class, opts, &loader.set);
+  loader.lineno = 0;
+  loader.len = 0;
+  loader.done = 0;
+  loader.buf = rb_str_buf_new(LOAD_CHUNK);
+  /* a Pathname responds to read too, but as File.read(path, ...) */
+  if (rb_obj_is_kind_of(source, rb_cIO) ||
+      (rb_respond_to(source, rb_intern("read")) && !rb_respond_to(source, rb_intern("to_path")))) {
+    loader.io = source;
+    set_load_io((VALUE) &loader);
+  } else {
+    FilePathValue(source);
+    loader.io = rb_file_open_str(source, "rb");
+    rb_ensure(set_load_io, (VALUE) &loader, rb_io_close, loader.io);
+  }
+  RB_GC_GUARD(loader.io);
+  RB_GC_GUARD(loader.buf);
+  set_built(loader.set);
+
+  return rbset;
+}
+
+/**
+ * Test if any network in this set includes +v+, with the same rules
+ * as {Subnets::Net4#include?} and {Subnets::Net6#include?}.
+ *
+ * @param [String, IP, Net] v
+ */
+VALUE
+method_set_include_p(VALUE self, VALUE v) {
+  set_t *set;
+  TypedData_Get_Struct(self, set_t, &set_type, set);
+  return set_include_p(set, v) ? Qtrue : Qfalse;
+}
+
+/**
+ * Test if any network in this set includes the address +i+ of IP
+ * version +version+, as by {#include?} of the IP4 or IP6 with that
+ * value but without making it.
+ *
+ * @overload include_i?(i, version = 4)
+ *   @param i [Integer]
+ *   @param version [Integer] 4 or 6
+ * @raise [RangeError] if +i+ is out of range for +version+
+ */
+VALUE
+method_set_include_i_p(int argc, VALUE *argv, VALUE self) {
+  const set_t *set;
+  addr_t addr;
+  VALUE i, version;
+
+  rb_scan_args(argc, argv, "11", &i, &version);
+  TypedData_Get_Struct(self, set_t, &set_type, set);
+
+  if (Qnil == version || version == INT2FIX(4)) {
+    addr.type = ADDR_IP4;
+    addr.u.ip4 = ip4_of_integer(i);
+  } else if (version == INT2FIX(6)) {
+    addr.type = ADDR_IP6;
+    addr.u.ip6 = ip6_of_integer(i);
+  } else {
+    rb_raise(rb_eArgError, "version must be 4 or 6, was %"PRIsVALUE, version);
+  }
+  return set_include_addr_p(set, &addr) ? Qtrue : Qfalse;
+}
+
+/*
+ * Batches of at least batch_threshold addresses are classified with
+ * the GVL released, split across batch_threads native threads.  The
+ * addresses are copied out of their Ruby objects a chunk of at most
+ * BATCH_CHUNK_BYTES at a time with the GVL held, so the workers never
+ * touch a Ruby object and the set they read is immutable.  Workers
+ * claim blocks of BATCH_BLOCK items of a chunk in order from a shared
+ * cursor and always finish a block they claimed, so when an interrupt
+ * stops them the items before the cursor are classified and the next
+ * chunk resumes from there.
+ *
+ * Threads are started per chunk rather than kept in a pool: a pool
+ * would hold idle threads for the life of the process and lose them
+ * across fork(), while starting a thread costs a few microseconds
+ * against the milliseconds of work in a chunk.
+ */
+static int batch_threads = 1;
+static long batch_threshold = 65536;
+
+#define BATCH_MAX_THREADS 256
+#define BATCH_CHUNK_BYTES (16 << 20)
+#define BATCH_BLOCK 1024        /* items claimed by a worker at once */
+
+enum { BATCH_NONE, BATCH_ADDR, BATCH_STR };
+
+/* 49 is longest possible ip6 cidr */
+#define BATCH_STR_MAX 56
+
+typedef struct {
+  union {
+    addr_t addr;
+    char str[BATCH_STR_MAX];
+  } u;
+  int kind;
+  int len;                      /* of str */
+} batch_item_t;
+
+#define BATCH_CHUNK (BATCH_CHUNK_BYTES / (long) sizeof(batch_item_t))
+
+typedef struct {
+  const set_t *set;
+  const batch_item_t *items;
+  uint8_t *results;
+  long len;
+  int nthreads;
+  long next;                    /* first item not claimed by a worker */
+  volatile int interrupted;
+} batch_t;
+
+/* classify blocks until none are left or interrupted, at least one */
+static void *
+batch_worker(void *p) {
+  batch_t *batch = p;
+
+  do {
+    long first = __atomic_fetch_add(&batch->next, BATCH_BLOCK, __ATOMIC_RELAXED);
+    long end = MIN(first + BATCH_BLOCK, batch->len);
+
+    if (first >= batch->len) break;
+    for (long i = first; i < end; i++) {
+      const batch_item_t *item = &batch->items[i];
+      addr_t addr;
+
+      if (item->kind == BATCH_ADDR) addr = item->u.addr;
+      else if (item->kind == BATCH_STR) addr_read(item->u.str, item->len, &addr);
+      else addr.type = ADDR_NONE;
+
+      batch->results[i] = set_include_addr_p(batch->set, &addr);
+    }
+  } while (!batch->interrupted);
+
+  return NULL;
+}
+
+#if defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL) && defined(HAVE_PTHREAD_H)
+static void *
+batch_run(void *p) {
+  batch_t *batch = p;
+  pthread_t threads[BATCH_MAX_THREADS];
+  int started[BATCH_MAX_THREADS];
+
+  for (int t = 1; t < batch->nthreads; t++) {
+    started[t] = !pthread_create(&threads[t], NULL, batch_worker, batch);
+  }
+  batch_worker(batch);
+  for (int t = 1; t < batch->nthreads; t++) {
+    if (started[t]) pthread_join(threads[t], NULL);
+  }
+
+  return NULL;
+}
+
+static void
+batch_ubf(void *p) {
+  batch_t *batch = p;
+  batch->interrupted = 1;
+}
+
+static void
+batch_run_without_gvl(batch_t *batch) {
+  rb_thread_call_without_gvl(batch_run, batch, batch_ubf, batch);
+}
+#else
+static void
+batch_run_without_gvl(batch_t *batch) {
+  batch_worker(batch);
+}
+#endif
+
+static void
+batch_item_of(VALUE v, batch_item_t *item) {
+  if (RB_TYPE_P(v, T_STRING)) {
+    long len = RSTRING_LEN(v);
+    if (len <= BATCH_STR_MAX) {
+      memcpy(item->u.str, RSTRING_PTR(v), len);
+      item->len = len;
+      item->kind = BATCH_STR;
+    } else {
+      item->kind = BATCH_NONE;
+    }
+  } else if (addr_of(v, &item->u.addr)) {
+    item->kind = BATCH_ADDR;
+  } else {
+    item->kind = BATCH_NONE;
+  }
+}
+
+/**
+ * Classify +ips+ against +set+ with the GVL released.
+ */
+static VALUE
+set_include_many_without_gvl(VALUE self, const set_t *set, VALUE ips) {
+  long len = RARRAY_LEN(ips);
+  batch_item_t *items;
+  uint8_t *results;
+  VALUE itemsbuf, resultsbuf, result;
+
+  items = ALLOCV_N(batch_item_t, itemsbuf, MIN(BATCH_CHUNK, len));
+  results = ALLOCV_N(uint8_t, resultsbuf, len);
+
+  for (long first = 0; first < len; ) {
+    batch_t batch;
+    long n = MIN(BATCH_CHUNK, len - first);
+
+    for (long i = 0; i < n; i++) {
+      if (first + i < RARRAY_LEN(ips)) {
+        batch_item_of(RARRAY_AREF(ips, first + i), &items[i]);
+      } else {
+        items[i].kind = BATCH_NONE;
+      }
+    }
+
+    batch.set = set;
+    batch.items = items;
+    batch.results = results + first;
+    batch.len = n;
+    batch.nthreads = MIN(batch_threads, (n + BATCH_BLOCK - 1) / BATCH_BLOCK);
+    batch.next = 0;
+    batch.interrupted = 0;
+
+    batch_run_without_gvl(&batch);
+
+    /* raises if interrupted by an exception, otherwise resume */
+    rb_thread_check_ints();
+    first += MIN(batch.next, n);
+  }
+
+  result = rb_ary_new_capa(len);
+  for (long i = 0; i < len; i++) {
+    rb_ary_push(result, results[i] ? Qtrue : Qfalse);
+  }
+
+  ALLOCV_END(itemsbuf);
+  ALLOCV_END(resultsbuf);
+  RB_GC_GUARD(self);
+
+  return result;
+}
+
+/**
+ * @return [Integer] the number of native threads used by
+ *   {Subnets::Set#include_many?} for large batches
+ */
+VALUE
+method_subnets_threads(VALUE mod) {
+  return INT2FIX(batch_threads);
+}
+
+/**
+ * @param n [Integer] the number of native threads used by
+ *   {Subnets::Set#include_many?} for large batches, defaults to the
+ *   number of online processors
+ */
+VALUE
+method_subnets_set_threads(VALUE mod, VALUE n) {
+  int threads = NUM2INT(n);
+  check_main_ractor("threads");
+  if (threads < 1 || threads > BATCH_MAX_THREADS) {
+    rb_raise(rb_eArgError, "threads must be in range [1,%d], was %d", BATCH_MAX_THREADS, threads);
+  }
+  batch_threads = threads;
+  return n;
+}
+
+/**
+ * @return [Integer] the batch size from which
+ *   {Subnets::Set#include_many?} releases the GVL
+ */
+VALUE
+method_subnets_thread_threshold(VALUE mod) {
+  return LONG2NUM(batch_threshold);
+}
+
+/**
+ * @param n [Integer] the batch size from which
+ *   {Subnets::Set#include_many?} releases the GVL, default 65536
+ */
+VALUE
+method_subnets_set_thread_threshold(VALUE mod, VALUE n) {
+  long threshold = NUM2LONG(n);
+  check_main_ractor("thread_threshold");
+  if (threshold < 1) {
+    rb_raise(rb_eArgError, "thread_threshold must be positive, was %ld", threshold);
+  }
+  batch_threshold = threshold;
+  return n;
+}
+
+/**
+ * Test each element of +ips+ as by {#include?}.
+ *
+ * Batches of at least {Subnets.thread_threshold} elements are
+ * classified without holding the GVL, so other Ruby threads keep
+ * running, split across {Subnets.threads} native threads.
+ *
+ * @param [Array<String, IP, Net>] ips
+ * @return [Array<Boolean>] whether this set includes each element of
+ *   +ips+
+ */
+VALUE
+method_set_include_many_p(VALUE self, VALUE ips) {
+  set_t *set;
+  VALUE result;
+
+  TypedData_Get_Struct(self, set_t, &set_type, set);
+  Check_Type(ips, T_ARRAY);
+
+  if (RARRAY_LEN(ips) >= batch_threshold) {
+    return set_include_many_without_gvl(self, set, ips);
+  }
+
+  result = rb_ary_new_capa(RARRAY_LEN(ips));
+
+  for (ssize_t i = 0; i < RARRAY_LEN(ips); i++) {
+    rb_ary_push(result, set_include_p(set, RARRAY_AREF(ips, i)) ? Qtrue : Qfalse);
+  }
+
+  return result;
+}
+
+/**
+ * @return [Integer] the number of distinct networks in this set
+ */
+VALUE
+method_set_size(VALUE self) {
+  set_t *set;
+  TypedData_Get_Struct(self, set_t, &set_type, set);
+  return SIZET2NUM((size_t) set->v4.count + set->v6.count);
+}
+
+/**
+ * @return [Symbol] the engine used for IPv4 lookups, :trie or :dir24_8
+ */
+VALUE
+method_set_engine(VALUE self) {
+  set_t *set;
+  TypedData_Get_Struct(self, set_t, &set_type, set);
+  return ID2SYM(rb_intern(set->dir24 ? "dir24_8" : "trie"));
+}
+
+/**
+ * @return [Integer] the number of bytes of memory held by this set
+ */
+VALUE
+method_set_memsize(VALUE self) {
+  set_t *set;
+  TypedData_Get_Struct(self, set_t, &set_type, set);
+  return SIZET2NUM(set_memsize(set));
+}
+
+/**
+ * @return [Hash{Symbol => Integer}] the +:size+ of this set's cache
+ *   of lookup results, zero if it has none, and its +:hits+ and
+ *   +:misses+
+ */
+VALUE
+method_set_cache_stats(VALUE self) {
+  set_t *set;
+  TypedData_Get_Struct(self, set_t, &set_type, set);
+  return cache_stats(&set->cache);
+}
+
+static int
+set_collect_node(const trie_node_t *node, void *list) {
+  return prefix_list_push(list, node->key, node->prefixlen);
+}
+
+/**
+ * Collect the aggregated networks of +trie+ into +list+.
+ *
+ * @return zero on success, -1 if +list+ could not be grown
+ */
+static int
+trie_prefixes(const trie_t *trie, prefix_list_t *list) {
+  if (trie_walk(trie, set_collect_node, list)) return -1;
+  list->len = aggregate_sorted(list->prefixes, list->len);
+  return 0;
+}
+
+enum { SET_UNION, SET_INTERSECT, SET_SUBTRACT };
+
+static int
+trie_op(int op, const trie_t *a, const trie_t *b, prefix_list_t *out) {
+  prefix_list_t pa, pb;
+  int err;
+
+  prefix_list_init(&pa);
+  prefix_list_init(&pb);
+  err = trie_prefixes(a, &pa) || trie_prefixes(b, &pb);
+  if (!err) {
+    switch (op) {
+    case SET_UNION:
+      err = prefixes_union(pa.prefixes, pa.len, pb.prefixes, pb.len, out);
+      break;
+    case SET_INTERSECT:
+      err = prefixes_intersect(pa.prefixes, pa.len, pb.prefixes, pb.len, out);
+      break;
+    default:
+      err = prefixes_subtract(pa.prefixes, pa.len, pb.prefixes, pb.len, a->maxlen, out);
+      break;
+    }
+  }
+  prefix_list_free(&pa);
+  prefix_list_free(&pb);
+  return err;
+}
+
+/**
+ * Make the set of the networks of +self+ and +other+ combined by
+ * +op+, with the engine and cache size of +self+.  Both sets are read
+ * as sorted lists of their networks, merged in one pass, and the
+ * result aggregated.
+ */
+static VALUE
+set_op(VALUE self, VALUE other, int op) {
+  const set_t *a, *b;
+  set_t *set;
+  prefix_list_t v4, v6;
+  VALUE rbset, opts;
+  int err;
+
+  TypedData_Get_Struct(self, set_t, &set_type, a);
+  TypedData_Get_Struct(other, set_t, &set_type, b);
+
+  opts = rb_hash_new();
+  rb_hash_aset(opts, ID2SYM(rb_intern("engine")), ID2SYM(rb_intern(a->dir24 ? "dir24_8" : "trie")));
+  rb_hash_aset(opts, ID2SYM(rb_intern("cache")), SIZET2NUM(cache_capacity(&a->cache)));
+  rbset = set_make(rb_obj_class(self), opts, &set);
+
+  /* nothing below raises, so the lists are always freed */
+  prefix_list_init(&v4);
+  prefix_list_init(&v6);
+  err = trie_op(op, &a->v4, &b->v4, &v4) || trie_op(op, &a->v6, &b->v6, &v6);
+  for (size_t i = 0; !err && i < v4.len; i++) {
+    const prefix_t *p = &v4.prefixes[i];
+    err = trie_insert(&set->v4, p->key, p->prefixlen, 1) ||
+      (set->dir24 && dir24_insert(set->dir24, trie_key_to_ip4(p->key), p->prefixlen));
+  }
+  for (size_t i = 0; !err && i < v6.len; i++) {
+    const prefix_t *p = &v6.prefixes[i];
+    err = trie_insert(&set->v6, p->key, p->prefixlen, 1);
+  }
+  prefix_list_free(&v4);
+  prefix_list_free(&v6);
+  if (err) rb_memerror();
+
+  set_built(set);
+  return rbset;
+}
+
+/**
+ * @param other [Set]
+ * @return [Set] the addresses in this set or +other+, as the fewest
+ *   networks, with the engine and cache size of this set
+ */
+VALUE
+method_set_union(VALUE self, VALUE other) {
+  return set_op(self, other, SET_UNION);
+}
+
+/**
+ * @param other [Set]
+ * @return [Set] the addresses in both this set and +other+, as the
+ *   fewest networks, with the engine and cache size of this set
+ */
+VALUE
+method_set_intersect(VALUE self, VALUE other) {
+  return set_op(self, other, SET_INTERSECT);
+}
+
+/**
+ * @param other [Set]
+ * @return [Set] the addresses in this set but not +other+, as the
+ *   fewest networks, with the engine and cache size of this set
+ */
+VALUE
+method_set_subtract(VALUE self, VALUE other) {
+  return set_op(self, other, SET_SUBTRACT);
+}
+
+static void
+raise_image_error(image_error_t err, VALUE path) {
+  switch (err) {
+  case IMAGE_OK:
+    return;
+  case IMAGE_ESYS:
+    rb_sys_fail_str(path);
+  case IMAGE_EMAGIC:
+    rb_raise(ImageError, "not a Subnets::Set image: %"PRIsVALUE, path);
+  case IMAGE_EVERSION:
+    rb_raise(ImageError, "unsupported Subnets::Set image version: %"PRIsVALUE, path);
+  case IMAGE_EENDIAN:
+    rb_raise(ImageError, "Subnets::Set images require a little-endian host");
+  default:
+    rb_raise(ImageError, "corrupt Subnets::Set image: %"PRIsVALUE, path);
+  }
+}
+
+/**
+ * Write this set's compiled tries, and DIR-24-8 table if it has one,
+ * to +path+ as an image that {Set.mmap} maps without rebuilding
+ * anything.  The image is written to a temporary file renamed over
+ * +path+, so readers never see a partial image.
+ *
+ * Images hold the set's arrays as they are in memory, little-endian,
+ * and are not portable to big-endian hosts.
+ *
+ * @param path [String] the file to write
+ * @return [self]
+ * @raise [SystemCallError] if the file could not be written
+ * @raise [Subnets::ImageError] on a big-endian host
+ */
+VALUE
+method_set_dump(VALUE self, VALUE path) {
+  set_t *set;
+  TypedData_Get_Struct(self, set_t, &set_type, set);
+  FilePathValue(path);
+  raise_image_error(image_write(StringValueCStr(path), &set->v4, &set->v6, set->dir24), path);
+  return self;
+}
+
+/**
+ * Map the image at +path+, written by {#dump}, read-only and use it
+ * as a Set in place.  Nothing is rebuilt, so loading takes time
+ * independent of the number of networks, and processes mapping the
+ * same file share its pages.  The image is checked to be consistent
+ * before use, but not that it was written from the same networks.
+ *
+ * @overload mmap(path, cache: 0)
+ *   @param path [String] the file to map
+ *   @param cache [Integer] the number of lookup results to cache, as
+ *     for {Set.new}
+ * @return [Set]
+ * @raise [SystemCallError] if the file could not be mapped
+ * @raise [Subnets::ImageError] if the file is not a valid image
+ */
+VALUE
+method_set_mmap(int argc, VALUE *argv, VALUE class) {
+  set_t *set;
+  VALUE rbset, path, opts, cache = Qnil;
+  long cachesize = 0;
+
+  rb_scan_args(argc, argv, "1:", &path, &opts);
+  FilePathValue(path);
+  if (Qnil != opts) {
+    cache = rb_hash_aref(opts, ID2SYM(rb_intern("cache")));
+  }
+  if (Qnil != cache && (cachesize = NUM2LONG(cache)) < 0) {
+    rb_raise(rb_eArgError, "cache must not be negative, was %ld", cachesize);
+  }
+
+  rbset = set_alloc(class, cachesize, &set);
+  raise_image_error(image_map(&set->image, StringValueCStr(path)), path);
+  set->v4 = set->image.v4;
+  set->v6 = set->image.v6;
+  if (set->image.has_dir24) set->dir24 = &set->image.dir24;
+  if (cache_init(&set->cache, cachesize)) rb_memerror();
+  set_built(set);
+
+  return rbset;
+}
+
+static const char *
+header_trim_left(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  return p;
+}
+
+static const char *
+header_trim_right(const char *p, const char *end) {
+  while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+  return end;
+}
+
+/**
+ * Read the IP of one comma-separated element, +p+ to +end+, of an
+ * X-Forwarded-For or Forwarded header into +addr+.  An element with
+ * an '=' is a Forwarded element, whose IP is in its for= parameter.
+ * The IP may be quoted and may have a port, as in "[::1]:80" or
+ * "192.0.2.1:80".
+ *
+ * @return ADDR_IP4, ADDR_IP6, or ADDR_NONE if there is no IP
+ */
+static addr_type_t
+header_addr_read(const char *p, const char *end, addr_t *addr) {
+  const char *colon;
+
+  addr->type = ADDR_NONE;
+
+  if (memchr(p, '=', end - p)) {
+    const char *pair = p, *pairend;
+    for (;; pair = pairend + 1) {
+      pair = header_trim_left(pair, end);
+      if (!(pairend = memchr(pair, ';', end - pair))) pairend = end;
+      if (pairend - pair >= 4 && !STRNCASECMP(pair, "for=", 4)) {
+        p = pair + 4;
+        end = pairend;
+        break;
+      }
+      if (pairend == end) return ADDR_NONE;
+    }
+  }
+
+  p = header_trim_left(p, end);
+  end = header_trim_right(p, end);
+
+  if (end - p >= 2 && *p == '"' && end[-1] == '"') {
+    p++;
+    end--;
+  }
+
+  if (p < end && *p == '[') {
+    const char *close = memchr(p, ']', end - p);
+    if (!close) return ADDR_NONE;
+    p++;
+    end = close;
+  } else if ((colon = memchr(p, ':', end - p)) && !memchr(colon + 1, ':', end - colon - 1)) {
+    end = colon;                /* ip4:port */
+  }
+
+  read_any_strict_n(p, end - p, addr);
+  if (addr->type == ADDR_NET4 || addr->type == ADDR_NET6) addr->type = ADDR_NONE;
+  return addr->type;
+}
+
+/**
+ * Test if +trusted+, a Set or an Array as given to
+ * {Subnets.include?}, includes +addr+.
+ */
+static int
+trusted_include_addr_p(VALUE trusted, const addr_t *addr) {
+  VALUE ip = Qnil;
+
+  if (rb_typeddata_is_kind_of(trusted, &set_type)) {
+    set_t *set;
+    TypedData_Get_Struct(trusted, set_t, &set_type, set);
+    return set_include_addr_p(set, addr);
+  }
+
+  for (ssize_t i = 0; i < RARRAY_LEN(trusted); i++) {
+    VALUE rbnet = RARRAY_AREF(trusted, i);
+
+    if (CLASS_OF(rbnet) == Net4) {
+      net4_t *net;
+      TypedData_Get_Struct(rbnet, net4_t, &net4_type, net);
+      if (net4_include_addr_p(*net, addr)) return 1;
+    } else if (CLASS_OF(rbnet) == Net6) {
+      net6_t *net;
+      TypedData_Get_Struct(rbnet, net6_t, &net6_type, net);
+      if (net6_include_addr_p(*net, addr)) return 1;
+    } else {
+      if (Qnil == ip) ip = addr_new(addr);
+      if (RTEST(rb_funcall(rbnet, rb_intern("==="), 1, ip))) return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Find the client IP of a request from its X-Forwarded-For or
+ * Forwarded (RFC 7239) header, as ActionDispatch::RemoteIp does: the
+ * header is read right to left, skipping elements that are not IPs
+ * and IPs of +trusted+ proxies, and the first other IP is the
+ * client.  If every IP is trusted, the leftmost one is the client.
+ *
+ * The header is parsed in place; no String is created per element.
+ *
+ * @example
+ *   Subnets.client_ip('203.0.113.9, 10.0.0.1', [Subnets.parse('10.0.0.0/8')])
+ *   #=> #<Subnets::IP4 203.0.113.9>
+ *   Subnets.client_ip('for=203.0.113.9, for="[2001:db8::1]:443"', set)
+ *
+ * @param header [String] the value of the header
+ * @param trusted [Set, Array<Net,Object>] the trusted proxies, as
+ *   given to {Subnets.include?}
+ * @return [IP4, IP6, nil] the client IP, or nil if the header holds
+ *   no IP
+ */
+VALUE
+method_subnets_client_ip(VALUE mod, VALUE header, VALUE trusted) {
+  addr_t addr, leftmost;
+  long pos;
+
+  StringValue(header);
+  if (!rb_typeddata_is_kind_of(trusted, &set_type)) Check_Type(trusted, T_ARRAY);
+
+  leftmost.type = ADDR_NONE;
+
+  /* offsets rather than pointers, in case a trusted#=== changes header */
+  for (pos = RSTRING_LEN(header); pos >= 0; pos--) {
+    const char *begin = RSTRING_PTR(header);
+    const char *end = begin + MIN(pos, RSTRING_LEN(header));
+    const char *p = end;
+
+    while (p > begin && p[-1] != ',') p--;
+    pos = p - begin;
+
+    if (header_addr_read(p, end, &addr)) {
+      if (!trusted_include_addr_p(trusted, &addr)) return addr_new(&addr);
+      leftmost = addr;
+    }
+  }
+
+  RB_GC_GUARD(header);
+  return addr_new(&leftmost);
+}
+
+/**
+ * A Table maps Net4 and Net6 networks to arbitrary values, held in
+ * the same prefix tries as {Subnets::Set}.  The value of each trie
+ * node is a 1-based index into an Array of the values.
+ */
+typedef struct {
+  trie_t v4;
+  trie_t v6;
+  VALUE values;
+} table_t;
+
+static void
+table_mark(void *p) {
+  table_t *table = p;
+  rb_gc_mark(table->values);
+}
+
+static void
+table_free(void *p) {
+  table_t *table = p;
+  trie_free(&table->v4);
+  trie_free(&table->v6);
+  xfree(table);
+}
+
+static size_t
+table_memsize(const void *p) {
+  const table_t *table = p;
+  return sizeof(table_t) + trie_memsize(&table->v4) + trie_memsize(&table->v6);
+}
+
+static const rb_data_type_t table_type = {
+  "Subnets::Table",
+  { table_mark, table_free, table_memsize, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+/**
+ * Associate +value+ with the network +net+, replacing any value
+ * previously associated with the same network.
+ *
+ * @param net [Net, IP, String] the network; IPs are single-address
+ *   networks and Strings are parsed as by {Subnets.parse}
+ * @param value [Object]
+ * @return [Object] value
+ * @raise {Subnets::ParseError}
+ */
+VALUE
+method_table_aset(VALUE self, VALUE net, VALUE value) {
+  table_t *table;
+  trie_t *trie;
+  trie_node_t *node;
+  trie_key_t key;
+  int prefixlen;
+
+  TypedData_Get_Struct(self, table_t, &table_type, table);
+  rb_check_frozen(self);
+
+  switch (trie_key_of(net, &key, &prefixlen)) {
+  case 4: trie = &table->v4; break;
+  case 6: trie = &table->v6; break;
+  default: raise_key_error(net); return Qnil;
+  }
+
+  if ((node = trie_find(trie, key, prefixlen))) {
+    rb_ary_store(table->values, node->value - 1, value);
+  } else {
+    rb_ary_push(table->values, value);
+    if (trie_insert(trie, key, prefixlen, RARRAY_LEN(table->values))) {
+      rb_ary_pop(table->values);
+      rb_memerror();
+    }
+  }
+
+  return value;
+}
+
+static int
+table_store_i(VALUE key, VALUE value, VALUE self) {
+  method_table_aset(self, key, value);
+  return ST_CONTINUE;
+}
+
+/**
+ * @overload new(routes={})
+ *   @param routes [Hash{Net,IP,String => Object}] initial entries,
+ *     as if added with {#[]=}
+ * @return [Table]
+ */
+VALUE
+method_table_new(int argc, VALUE *argv, VALUE class) {
+  table_t *table;
+  VALUE rbtable, routes;
+
+  rb_scan_args(argc, argv, "01", &routes);
+
+  rbtable = TypedData_Make_Struct(class, table_t, &table_type, table);
+  table->values = rb_ary_new();
+  if (trie_init(&table->v4, 32) || trie_init(&table->v6, 128)) {
+    rb_memerror();
+  }
+
+  if (Qnil != routes) {
+    rb_hash_foreach(rb_convert_type(routes, T_HASH, "Hash", "to_hash"), table_store_i, rbtable);
+  }
+
+  return rbtable;
+}
+
+static const trie_node_t *
+table_lookup(const table_t *table, VALUE v, int *family) {
+  trie_key_t key;
+  int prefixlen;
+
+  switch ((*family = trie_key_of(v, &key, &prefixlen))) {
+  case 4: return trie_match_longest(&table->v4, key, prefixlen);
+  case 6: return trie_match_longest(&table->v6, key, prefixlen);
+  default: return NULL;
+  }
+}
+
+/**
+ * Find the value of the most specific network that includes +v+,
+ * with the same rules as {Subnets::Net4#include?} and
+ * {Subnets::Net6#include?}.
+ *
+ * @param v [String, IP, Net]
+ * @return [Object, nil] the value, or nil if no network includes +v+
+ */
+VALUE
+method_table_aref(VALUE self, VALUE v) {
+  table_t *table;
+  const trie_node_t *node;
+  int family;
+
+  TypedData_Get_Struct(self, table_t, &table_type, table);
+  if (!(node = table_lookup(table, v, &family))) return Qnil;
+  return RARRAY_AREF(table->values, node->value - 1);
+}
+
+/**
+ * Like {#[]}, but also returns the matching network.
+ *
+ * @param v [String, IP, Net]
+ * @return [Array(Net, Object), nil] the most specific network that
+ *   includes +v+ and its value, or nil if there is none
+ */
+VALUE
+method_table_match(VALUE self, VALUE v) {
+  table_t *table;
+  const trie_node_t *node;
+  VALUE rbnet;
+  int family;
+
+  TypedData_Get_Struct(self, table_t, &table_type, table);
+  if (!(node = table_lookup(table, v, &family))) return Qnil;
+
+  if (family == 4) {
+    net4_t net;
+    net.address = trie_key_to_ip4(node->key);
+    net.prefixlen = node->prefixlen;
+    net.mask = mk_mask4(net.prefixlen);
+    rbnet = net4_new(Net4, net);
+  } else {
+    net6_t net;
+    net.address = trie_key_to_ip6(node->key);
+    net.prefixlen = node->prefixlen;
+    net.mask = mk_mask6(net.prefixlen);
+    rbnet = net6_new(Net6, net);
+  }
+
+  return rb_assoc_new(rbnet, RARRAY_AREF(table->values, node->value - 1));
+}
+
+/**
+ * @return [Integer] the number of networks in this table
+ */
+VALUE
+method_table_size(VALUE self) {
+  table_t *table;
+  TypedData_Get_Struct(self, table_t, &table_type, table);
+  return SIZET2NUM((size_t) table->v4.count + table->v6.count);
+}
+
+VALUE
+method_ip_inspect(VALUE ip) {
+  VALUE fmt = rb_str_new_cstr("#<%s %s>");
+  VALUE args = rb_ary_new_from_args(2,
+                                    rb_funcall(ip, rb_intern("class"), 0),
+                                    rb_funcall(ip, rb_intern("to_s"), 0));
+  return rb_funcall(fmt, rb_intern("%"), 1, args);
+}
+
+VALUE
+method_net_inspect(VALUE net) {
+  VALUE fmt = rb_str_new_cstr("#<%s address=%s prefixlen=%d mask=%s>");
+  VALUE args = rb_ary_new_from_args(4,
+                                    rb_funcall(net, rb_intern("class"), 0),
+                                    rb_funcall(net, rb_intern("address"), 0),
+                                    rb_funcall(net, rb_intern("prefixlen"), 0),
+                                    rb_funcall(net, rb_intern("mask"), 0));
+  return rb_funcall(fmt, rb_intern("%"), 1, args);
+}
+
+/**
+ * A LiveSet holds the current snapshot of a Set whose networks change
+ * over time.  Readers load the snapshot with no lock; a snapshot is
+ * never modified, so a reader sees it consistent for as long as it
+ * holds it, and the GC reclaims it once no reader does.  Writers build
+ * a new snapshot off to the side, then publish it by replacing the one
+ * reference.  Writers hold +lock+ so that concurrent updates do not
+ * lose each other's changes; readers never take it.
+ */
+typedef struct {
+  VALUE set;                    /* the current snapshot */
+  VALUE opts;                   /* engine and cache of new snapshots */
+  VALUE lock;                   /* held by writers */
+} live_set_t;
+
+static void
+live_set_mark(void *p) {
+  live_set_t *live = p;
+  rb_gc_mark(live->set);
+  rb_gc_mark(live->opts);
+  rb_gc_mark(live->lock);
+}
+
+static size_t
+live_set_memsize(const void *p) {
+  return sizeof(live_set_t);
+}
+
+static const rb_data_type_t live_set_type = {
+  "Subnets::LiveSet",
+  { live_set_mark, RUBY_TYPED_DEFAULT_FREE, live_set_memsize, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+/* the current snapshot; a single load, so never torn */
+static VALUE
+live_set_snapshot(VALUE self) {
+  live_set_t *live;
+  TypedData_Get_Struct(self, live_set_t, &live_set_type, live);
+  return live->set;
+}
+
+/**
+ * The nets as a Set with the engine and cache of new snapshots.
+ */
+static VALUE
+live_set_compile(const live_set_t *live, VALUE nets) {
+  if (rb_typeddata_is_kind_of(nets, &set_type)) return nets;
+  return set_new(Set, nets, live->opts);
+}
+
+typedef struct {
+  live_set_t *live;
+  VALUE set;
+  int op;                       /* -1 to replace */
+} live_set_update_t;
+
+static VALUE
+live_set_update_i(VALUE arg) {
+  live_set_update_t *update = (live_set_update_t *) arg;
+  live_set_t *live = update->live;
+
+  if (update->op < 0) {
+    live->set = update->set;
+  } else {
+    live->set = set_op(live->set, update->set, update->op);
+  }
+  return Qnil;
+}
+
+static VALUE
+live_set_update(VALUE self, VALUE nets, int op) {
+  live_set_update_t update;
+
+  TypedData_Get_Struct(self, live_set_t, &live_set_type, update.live);
+  update.set = live_set_compile(update.live, nets);
+  update.op = op;
+  rb_mutex_synchronize(update.live->lock, live_set_update_i, (VALUE) &update);
+
+  RB_GC_GUARD(update.set);
+  return self;
+}
+
+/**
+ * @overload new(nets = [], engine: :trie, cache: 0)
+ *   @param nets [Array<Net4, Net6, IP4, IP6, String>, Set] the
+ *     initial networks
+ *   @param engine [Symbol] the engine of each snapshot, as for
+ *     {Set.new}
+ *   @param cache [Integer] the cache size of each snapshot, as for
+ *     {Set.new}
+ * @return [LiveSet]
+ * @raise {Subnets::ParseError}
+ */
+VALUE
+method_live_set_new(int argc, VALUE *argv, VALUE class) {
+  live_set_t *live;
+  VALUE rblive, nets, opts;
+
+  rb_scan_args(argc, argv, "01:", &nets, &opts);
+
+  rblive = TypedData_Make_Struct(class, live_set_t, &live_set_type, live);
+  live->set = live->opts = live->lock = Qnil;
+  if (Qnil != opts) live->opts = rb_hash_freeze(rb_hash_dup(opts));
+  live->lock = rb_mutex_new();
+  live->set = live_set_compile(live, Qnil == nets ? rb_ary_new() : nets);
+
+  return rblive;
+}
+
+/**
+ * Publish +nets+ as the new snapshot.
+ *
+ * @param nets [Array<Net4, Net6, IP4, IP6, String>, Set] the networks
+ *   of the new snapshot; a Set is published as is
+ * @return [self]
+ * @raise {Subnets::ParseError}
+ */
+VALUE
+method_live_set_replace(VALUE self, VALUE nets) {
+  return live_set_update(self, nets, -1);
+}
+
+/**
+ * Publish a new snapshot of the current networks and +nets+.
+ *
+ * @param nets [Array<Net4, Net6, IP4, IP6, String>, Set]
+ * @return [self]
+ * @raise {Subnets::ParseError}
+ */
+VALUE
+method_live_set_add(VALUE self, VALUE nets) {
+  return live_set_update(self, nets, SET_UNION);
+}
+
+/**
+ * Publish a new snapshot of the current networks without the
+ * addresses of +nets+.
+ *
+ * @param nets [Array<Net4, Net6, IP4, IP6, String>, Set]
+ * @return [self]
+ * @raise {Subnets::ParseError}
+ */
+VALUE
+method_live_set_remove(VALUE self, VALUE nets) {
+  return live_set_update(self, nets, SET_SUBTRACT);
+}
+
+/**
+ * @return [Set] the current snapshot, which later updates leave
+ *   unchanged
+ */
+VALUE
+method_live_set_snapshot(VALUE self) {
+  return live_set_snapshot(self);
+}
+
+/**
+ * (see Subnets::Set#include?)
+ */
+VALUE
+method_live_set_include_p(VALUE self, VALUE v) {
+  return method_set_include_p(live_set_snapshot(self), v);
+}
+
+/**
+ * (see Subnets::Set#include_i?)
+ */
+VALUE
+method_live_set_include_i_p(int argc, VALUE *argv, VALUE self) {
+  return method_set_include_i_p(argc, argv, live_set_snapshot(self));
+}
+
+/**
+ * (see Subnets::Set#include_many?)
+ *
+ * All of +ips+ are tested against the same snapshot.
+ */
+VALUE
+method_live_set_include_many_p(VALUE self, VALUE ips) {
+  return method_set_include_many_p(live_set_snapshot(self), ips);
+}
+
+/**
+ * (see Subnets::Set#size)
+ */
+VALUE
+method_live_set_size(VALUE self) {
+  return method_set_size(live_set_snapshot(self));
+}
+
+/**
+ *
+ */
+void Init_Subnets() {
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+  rb_ext_ractor_safe(true);
+#endif
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+  main_ractor_key = rb_ractor_local_storage_value_newkey();
+  rb_ractor_local_storage_value_set(main_ractor_key, Qtrue);
+#endif
+
+  compiled_ids = rb_obj_hide(rb_hash_new());
+  rb_global_variable(&compiled_ids);
+  compiled_arrays = rb_class_new_instance(0, NULL, rb_path2class("ObjectSpace::WeakMap"));
+  rb_global_variable(&compiled_arrays);
+
+#ifdef _SC_NPROCESSORS_ONLN
+  batch_threads = MIN(BATCH_MAX_THREADS, MAX(1, sysconf(_SC_NPROCESSORS_ONLN)));
+#endif
+  
+  // Subnets
+  Subnets = rb_define_module("Subnets");
+  rb_define_singleton_method(Subnets, "parse", method_subnets_parse, -1);
+  rb_define_singleton_method(Subnets, "parse_cache_size", method_subnets_parse_cache_size, 0);
+  rb_define_singleton_method(Subnets, "parse_cache_size=", method_subnets_set_parse_cache_size, 1);
+  rb_define_singleton_method(Subnets, "parse_cache_stats", method_subnets_parse_cache_stats, 0);
+  rb_define_singleton_method(Subnets, "include?", method_subnets_include_p, 2);
+  rb_define_singleton_method(Subnets, "include_many?", method_subnets_include_many_p, 2);
+  rb_define_singleton_method(Subnets, "client_ip", method_subnets_client_ip, 2);
+  rb_define_singleton_method(Subnets, "aggregate", method_subnets_aggregate, 1);
+  rb_define_singleton_method(Subnets, "sort", method_subnets_sort, 1);
+  rb_define_singleton_method(Subnets, "threads", method_subnets_threads, 0);
+  rb_define_singleton_method(Subnets, "threads=", method_subnets_set_threads, 1);
+  rb_define_singleton_method(Subnets, "thread_threshold", method_subnets_thread_threshold, 0);
+  rb_define_singleton_method(Subnets, "thread_threshold=", method_subnets_set_thread_threshold, 1);
+
+  // Subnets::ParseError
+  ParseError = rb_define_class_under(Subnets, "ParseError", rb_eArgError);
+
+  // Subnets::ImageError
+  ImageError = rb_define_class_under(Subnets, "ImageError", rb_eStandardError);
+
+  // Subnets::IP
+  IP = rb_define_class_under(Subnets, "IP", rb_cObject);
+  rb_define_method(IP, "inspect", method_ip_inspect, 0);
+  rb_include_module(IP, rb_mComparable);
+
+  // Subnets::IP4
+  IP4 = rb_define_class_under(Subnets, "IP4", IP);
+  rb_define_singleton_method(IP4, "random", method_ip4_random, -1);
+  rb_undef_alloc_func(IP4);
+  rb_define_singleton_method(IP4, "new", method_ip4_new, 1);
+  rb_define_method(IP4, "==", method_ip4_eql_p, 1);
+  rb_define_method(IP4, "<=>", method_ip4_cmp, 1);
+  rb_define_alias(IP4, "eql?", "==");
+  rb_define_method(IP4, "hash", method_ip4_hash, 0);
   rb_define_method(IP4, "to_s", method_ip4_to_s, 0);
   rb_define_method(IP4, "to_i", method_ip4_to_i, 0);
 
@@ -1071,8 +3430,10 @@ void Init_Subnets() {
   // Subnets::IP6
   IP6 = rb_define_class_under(Subnets, "IP6", IP);
   rb_define_singleton_method(IP6, "random", method_ip6_random, -1);
+  rb_undef_alloc_func(IP6);
   rb_define_singleton_method(IP6, "new", method_ip6_new, 1);
   rb_define_method(IP6, "==", method_ip6_eql_p, 1);
+  rb_define_method(IP6, "<=>", method_ip6_cmp, 1);
   rb_define_alias(IP6, "eql?", "==");
   rb_define_method(IP6, "hash", method_ip6_hash, 0);
   rb_define_method(IP6, "to_s", method_ip6_to_s, 0);
@@ -1087,19 +3448,23 @@ void Init_Subnets() {
   // Subnets::Net
   Net = rb_define_class_under(Subnets, "Net", rb_cObject);
   rb_define_method(Net, "inspect", method_net_inspect, 0);
+  rb_include_module(Net, rb_mComparable);
 
   // Subnets::Net4
   Net4 = rb_define_class_under(Subnets, "Net4", Net);
-  rb_define_singleton_method(Net4, "parse", method_net4_parse, 1);
+  rb_define_singleton_method(Net4, "parse", method_net4_parse, -1);
   rb_define_singleton_method(Net4, "random", method_net4_random, -1);
+  rb_undef_alloc_func(Net4);
   rb_define_singleton_method(Net4, "new", method_net4_new, 2);
   rb_define_singleton_method(Net4, "summarize", method_net4_summarize, 1);
   rb_define_method(Net4, "==", method_net4_eql_p, 1);
+  rb_define_method(Net4, "<=>", method_net4_cmp, 1);
   rb_define_alias(Net4, "eql?", "==");
   rb_define_method(Net4, "hash", method_net4_hash, 0);
   rb_define_method(Net4, "to_s", method_net4_to_s, 0);
   rb_define_method(Net4, "prefixlen", method_net4_prefixlen, 0);
   rb_define_method(Net4, "include?", method_net4_include_p, 1);
+  rb_define_method(Net4, "include_i?", method_net4_include_i_p, 1);
   rb_define_alias(Net4, "===", "include?");
 
   rb_define_method(Net4, "address", method_net4_address, 0);
@@ -1107,21 +3472,66 @@ void Init_Subnets() {
 
   // Subnets::Net6
   Net6 = rb_define_class_under(Subnets, "Net6", Net);
-  rb_define_singleton_method(Net6, "parse", method_net6_parse, 1);
+  rb_define_singleton_method(Net6, "parse", method_net6_parse, -1);
   rb_define_singleton_method(Net6, "random", method_net6_random, -1);
+  rb_undef_alloc_func(Net6);
   rb_define_singleton_method(Net6, "new", method_net6_new, 2);
   rb_define_singleton_method(Net6, "summarize", method_net6_summarize, 1);
   rb_define_method(Net6, "==", method_net6_eql_p, 1);
+  rb_define_method(Net6, "<=>", method_net6_cmp, 1);
   rb_define_alias(Net6, "eql?", "==");
   rb_define_method(Net6, "hash", method_net6_hash, 0);
   rb_define_method(Net6, "to_s", method_net6_to_s, 0);
   rb_define_method(Net6, "prefixlen", method_net6_prefixlen, 0);
   rb_define_method(Net6, "include?", method_net6_include_p, 1);
+  rb_define_method(Net6, "include_i?", method_net6_include_i_p, 1);
   rb_define_method(Net6, "hextets", method_net6_hextets, 0);
   rb_define_alias(Net6, "===", "include?");
 
   rb_define_method(Net6, "address", method_net6_address, 0);
   rb_define_method(Net6, "mask", method_net6_mask, 0);
+
+  // Subnets::Set
+  Set = rb_define_class_under(Subnets, "Set", rb_cObject);
+  rb_undef_alloc_func(Set);
+  rb_define_singleton_method(Set, "new", method_set_new, -1);
+  rb_define_singleton_method(Set, "load", method_set_load, -1);
+  rb_define_method(Set, "include?", method_set_include_p, 1);
+  rb_define_method(Set, "include_i?", method_set_include_i_p, -1);
+  rb_define_alias(Set, "===", "include?");
+  rb_define_method(Set, "include_many?", method_set_include_many_p, 1);
+  rb_define_method(Set, "size", method_set_size, 0);
+  rb_define_method(Set, "engine", method_set_engine, 0);
+  rb_define_method(Set, "memsize", method_set_memsize, 0);
+  rb_define_method(Set, "cache_stats", method_set_cache_stats, 0);
+  rb_define_method(Set, "|", method_set_union, 1);
+  rb_define_method(Set, "&", method_set_intersect, 1);
+  rb_define_method(Set, "-", method_set_subtract, 1);
+  rb_define_singleton_method(Set, "mmap", method_set_mmap, -1);
+  rb_define_method(Set, "dump", method_set_dump, 1);
+
+  // Subnets::LiveSet
+  LiveSet = rb_define_class_under(Subnets, "LiveSet", rb_cObject);
+  rb_undef_alloc_func(LiveSet);
+  rb_define_singleton_method(LiveSet, "new", method_live_set_new, -1);
+  rb_define_method(LiveSet, "replace", method_live_set_replace, 1);
+  rb_define_method(LiveSet, "add", method_live_set_add, 1);
+  rb_define_method(LiveSet, "remove", method_live_set_remove, 1);
+  rb_define_method(LiveSet, "snapshot", method_live_set_snapshot, 0);
+  rb_define_method(LiveSet, "include?", method_live_set_include_p, 1);
+  rb_define_method(LiveSet, "include_i?", method_live_set_include_i_p, -1);
+  rb_define_alias(LiveSet, "===", "include?");
+  rb_define_method(LiveSet, "include_many?", method_live_set_include_many_p, 1);
+  rb_define_method(LiveSet, "size", method_live_set_size, 0);
+
+  // Subnets::Table
+  Table = rb_define_class_under(Subnets, "Table", rb_cObject);
+  rb_undef_alloc_func(Table);
+  rb_define_singleton_method(Table, "new", method_table_new, -1);
+  rb_define_method(Table, "[]=", method_table_aset, 2);
+  rb_define_method(Table, "[]", method_table_aref, 1);
+  rb_define_method(Table, "match", method_table_match, 1);
+  rb_define_method(Table, "size", method_table_size, 0);
 }
 
 void Init_subnets() {
@@ -3,4 +3,34 @@ require 'mkmf'
 have_header('ctype.h')
 have_header('stdint.h')
 
+# store IPs and nets inside their Ruby objects (Ruby 3.3+)
+have_const('RUBY_TYPED_EMBEDDABLE', 'ruby.h')
+
+# share IPs, nets and sets between Ractors (Ruby 3.0+)
+have_const('RUBY_TYPED_FROZEN_SHAREABLE', 'ruby.h')
+have_func('rb_ext_ractor_safe', 'ruby.h')
+have_func('rb_ractor_local_storage_value_newkey', 'ruby/ractor.h')
+
+# release the GVL for large batches in Subnets::Set#include_many?
+have_header('pthread.h') && have_library('pthread', 'pthread_create')
+have_func('rb_thread_call_without_gvl', 'ruby/thread.h')
+
+# map images written by Subnets::Set#dump in Subnets::Set.mmap
+have_func('mmap', 'sys/mman.h')
+
+# gem install subnets -- --enable-dir24-8
+#
+# make the DIR-24-8 table the default engine for IPv4 lookups in
+# Subnets::Set
+if enable_config('dir24-8', false)
+  $defs << '-DSUBNETS_DIR24_8'
+end
+
+# gem install subnets -- --disable-simd
+#
+# parse with the portable readers only, even on CPUs with SSE4.1
+unless enable_config('simd', true)
+  $defs << '-DSUBNETS_NO_SIMD'
+end
+
 create_makefile('subnets')
@@ -0,0 +1,270 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#include "image.h"
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+enum { SEC_V4, SEC_V4_JUMP, SEC_V6, SEC_V6_JUMP, SEC_TBL24, SEC_TBLLONG, NSECTIONS };
+
+typedef char image_header_is_64_bytes[sizeof(image_header_t) == 64 ? 1 : -1];
+typedef char trie_node_is_32_bytes[sizeof(trie_node_t) == 32 ? 1 : -1];
+
+static int
+little_endian(void) {
+  uint16_t x = 1;
+  return *(uint8_t *) &x == 1;
+}
+
+static uint64_t
+align_up(uint64_t n) {
+  return (n + IMAGE_ALIGN - 1) & ~(uint64_t) (IMAGE_ALIGN - 1);
+}
+
+/**
+ * Find the offset and length of each section of an image with header
+ * +h+.
+ *
+ * @return the size of the image, or zero if it would not fit in a
+ * size_t
+ */
+static size_t
+image_layout(const image_header_t *h, size_t *off, size_t *len) {
+  uint64_t n[NSECTIONS], pos = align_up(sizeof(image_header_t));
+  int dir24 = h->flags & IMAGE_DIR24;
+
+  n[SEC_V4] = (uint64_t) h->v4_len * sizeof(trie_node_t);
+  n[SEC_V4_JUMP] = h->v4_jump ? sizeof(trie_jump_t) << TRIE_JUMP_BITS : 0;
+  n[SEC_V6] = (uint64_t) h->v6_len * sizeof(trie_node_t);
+  n[SEC_V6_JUMP] = h->v6_jump ? sizeof(trie_jump_t) << TRIE_JUMP_BITS : 0;
+  n[SEC_TBL24] = dir24 ? DIR24_TBL24_SIZE * sizeof(uint32_t) : 0;
+  n[SEC_TBLLONG] = dir24 ? (uint64_t) h->dir24_nblocks * DIR24_BLOCK_SIZE : 0;
+
+  /* each section is under 2^40 bytes, so this cannot overflow */
+  for (int i = 0; i < NSECTIONS; i++) {
+    off[i] = pos;
+    len[i] = n[i];
+    pos = align_up(pos + n[i]);
+  }
+  return pos > SIZE_MAX / 2 ? 0 : pos;
+}
+
+#ifdef HAVE_MMAP
+/*
+ * Create and open a new file named +path+ followed by a random suffix
+ * of ".XXXXXX", writing the name to +tmp+.  Unlike mkstemp, the file
+ * is created with mode 0666 less the umask, without reading the umask
+ * by changing it, which would race with other threads creating files.
+ */
+static int
+open_temp(char *tmp, const char *path) {
+  struct timespec ts;
+  int fd;
+
+  for (uint64_t tries = 1; tries <= 100; tries++) {
+    uint64_t x;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    x = (uint64_t) ts.tv_sec << 32 ^ (uint64_t) ts.tv_nsec ^ (uint64_t) getpid() << 40 ^
+      (uintptr_t) &ts ^ tries * 0x9e3779b97f4a7c15ULL;
+    /* splitmix64 finalizer */
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+
+    sprintf(tmp, "%s.%06x", path, (unsigned) (x & 0xffffff));
+    fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd >= 0 || errno != EEXIST) return fd;
+  }
+  return -1;
+}
+
+image_error_t
+image_write(const char *path, const trie_t *v4, const trie_t *v6, const dir24_t *dir24) {
+  static const char zeros[IMAGE_ALIGN];
+  image_header_t h;
+  const void *data[NSECTIONS];
+  size_t off[NSECTIONS], len[NSECTIONS], pos;
+  char *tmp;
+  FILE *f;
+  int fd, err;
+
+  if (!little_endian()) return IMAGE_EENDIAN;
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, IMAGE_MAGIC, sizeof(h.magic));
+  h.version = IMAGE_VERSION;
+  h.flags = dir24 ? IMAGE_DIR24 : 0;
+  h.v4_len = v4->len;
+  h.v4_count = v4->count;
+  h.v4_jump = v4->jump != NULL;
+  h.v6_len = v6->len;
+  h.v6_count = v6->count;
+  h.v6_jump = v6->jump != NULL;
+  h.dir24_nblocks = dir24 ? dir24->nblocks : 0;
+  h.size = image_layout(&h, off, len);
+
+  data[SEC_V4] = v4->nodes;
+  data[SEC_V4_JUMP] = v4->jump;
+  data[SEC_V6] = v6->nodes;
+  data[SEC_V6_JUMP] = v6->jump;
+  data[SEC_TBL24] = dir24 ? dir24->tbl24 : NULL;
+  data[SEC_TBLLONG] = dir24 ? dir24->tbllong : NULL;
+
+  if (!(tmp = malloc(strlen(path) + sizeof(".XXXXXX")))) return IMAGE_ESYS;
+  if ((fd = open_temp(tmp, path)) < 0) {
+    err = errno;
+    free(tmp);
+    errno = err;
+    return IMAGE_ESYS;
+  }
+
+  if (!(f = fdopen(fd, "wb"))) {
+    err = errno;
+    close(fd);
+    goto fail;
+  }
+
+  fwrite(&h, sizeof(h), 1, f);
+  pos = sizeof(h);
+  for (int i = 0; i < NSECTIONS; i++) {
+    if (!len[i]) continue;
+    fwrite(zeros, 1, off[i] - pos, f);
+    fwrite(data[i], 1, len[i], f);
+    pos = off[i] + len[i];
+  }
+  fwrite(zeros, 1, h.size - pos, f);
+
+  if (ferror(f)) {
+    err = errno;
+    fclose(f);
+    goto fail;
+  }
+  if (fclose(f) || rename(tmp, path)) {
+    err = errno;
+    goto fail;
+  }
+
+  free(tmp);
+  return IMAGE_OK;
+
+ fail:
+  unlink(tmp);
+  free(tmp);
+  errno = err;
+  return IMAGE_ESYS;
+}
+
+image_error_t
+image_map(image_t *img, const char *path) {
+  image_header_t h;
+  size_t off[NSECTIONS], len[NSECTIONS];
+  struct stat st;
+  image_error_t ret = IMAGE_OK;
+  char *base;
+  int fd, err;
+
+  memset(img, 0, sizeof(*img));
+  if (!little_endian()) return IMAGE_EENDIAN;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) return IMAGE_ESYS;
+  if (fstat(fd, &st)) {
+    err = errno;
+    close(fd);
+    errno = err;
+    return IMAGE_ESYS;
+  }
+  if (st.st_size < (off_t) sizeof(h)) {
+    close(fd);
+    return IMAGE_EMAGIC;
+  }
+
+  base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  err = errno;
+  close(fd);
+  if (base == MAP_FAILED) {
+    errno = err;
+    return IMAGE_ESYS;
+  }
+  img->base = base;
+  img->size = st.st_size;
+
+  memcpy(&h, base, sizeof(h));
+  if (memcmp(h.magic, IMAGE_MAGIC, sizeof(h.magic))) {
+    ret = IMAGE_EMAGIC;
+  } else if (h.version != IMAGE_VERSION) {
+    ret = IMAGE_EVERSION;
+  } else if ((h.flags & ~IMAGE_DIR24) || h.size != img->size || !h.v4_len || !h.v6_len ||
+             image_layout(&h, off, len) != h.size) {
+    ret = IMAGE_ECORRUPT;
+  }
+  if (ret) goto fail;
+
+  img->v4.nodes = (trie_node_t *) (base + off[SEC_V4]);
+  img->v4.len = img->v4.cap = h.v4_len;
+  img->v4.count = h.v4_count;
+  img->v4.maxlen = 32;
+  img->v4.jump = h.v4_jump ? (trie_jump_t *) (base + off[SEC_V4_JUMP]) : NULL;
+
+  img->v6.nodes = (trie_node_t *) (base + off[SEC_V6]);
+  img->v6.len = img->v6.cap = h.v6_len;
+  img->v6.count = h.v6_count;
+  img->v6.maxlen = 128;
+  img->v6.jump = h.v6_jump ? (trie_jump_t *) (base + off[SEC_V6_JUMP]) : NULL;
+
+  if ((img->has_dir24 = h.flags & IMAGE_DIR24)) {
+    img->dir24.tbl24 = (uint32_t *) (base + off[SEC_TBL24]);
+    img->dir24.tbllong = h.dir24_nblocks ? (uint8_t *) (base + off[SEC_TBLLONG]) : NULL;
+    img->dir24.nblocks = img->dir24.capblocks = h.dir24_nblocks;
+  }
+
+  if (trie_check(&img->v4) || trie_check(&img->v6) ||
+      (img->has_dir24 && dir24_check(&img->dir24))) {
+    ret = IMAGE_ECORRUPT;
+    goto fail;
+  }
+
+  return IMAGE_OK;
+
+ fail:
+  image_unmap(img);
+  return ret;
+}
+
+void
+image_unmap(image_t *img) {
+  if (img->base) munmap(img->base, img->size);
+  memset(img, 0, sizeof(*img));
+}
+#else
+image_error_t
+image_write(const char *path, const trie_t *v4, const trie_t *v6, const dir24_t *dir24) {
+  errno = ENOSYS;
+  return IMAGE_ESYS;
+}
+
+image_error_t
+image_map(image_t *img, const char *path) {
+  memset(img, 0, sizeof(*img));
+  errno = ENOSYS;
+  return IMAGE_ESYS;
+}
+
+void
+image_unmap(image_t *img) {
+}
+#endif                          /* HAVE_MMAP */
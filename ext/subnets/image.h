@@ -0,0 +1,78 @@
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dir24.h"
+#include "trie.h"
+
+#define IMAGE_MAGIC "SUBNETS\x1a"
+#define IMAGE_VERSION 1
+
+/* the image includes a DIR-24-8 table */
+#define IMAGE_DIR24 1
+
+/**
+ * The header of an image of a compiled set.  All integers of the
+ * image are little-endian.  The header is followed by these sections,
+ * each starting at a multiple of IMAGE_ALIGN bytes: the v4 trie
+ * nodes, its jump table if v4_jump, the v6 trie nodes, its jump table
+ * if v6_jump, then, with IMAGE_DIR24, tbl24 and dir24_nblocks
+ * overflow blocks.  Nodes refer to each other by index, so the image
+ * is used in place wherever it is mapped.
+ */
+typedef struct {
+  char magic[8];                /* IMAGE_MAGIC */
+  uint32_t version;             /* IMAGE_VERSION */
+  uint32_t flags;
+  uint64_t size;                /* of the whole image */
+  uint32_t v4_len, v4_count, v4_jump;
+  uint32_t v6_len, v6_count, v6_jump;
+  uint32_t dir24_nblocks;
+  uint32_t reserved[3];
+} image_header_t;
+
+#define IMAGE_ALIGN 64
+
+typedef enum {
+  IMAGE_OK = 0,
+  IMAGE_ESYS = -1,              /* see errno */
+  IMAGE_EMAGIC = -2,            /* not an image */
+  IMAGE_EVERSION = -3,          /* an image of another version */
+  IMAGE_ECORRUPT = -4,          /* truncated or inconsistent */
+  IMAGE_EENDIAN = -5,           /* this host is not little-endian */
+} image_error_t;
+
+/**
+ * The tries and optional DIR-24-8 table of a compiled set, pointing
+ * into an image mapped read-only.
+ */
+typedef struct {
+  void *base;
+  size_t size;
+  trie_t v4;
+  trie_t v6;
+  dir24_t dir24;
+  int has_dir24;
+} image_t;
+
+/**
+ * Write an image of the given tries and table (which may be NULL) to
+ * +path+.  The image is written to a temporary file that is then
+ * renamed over +path+, so processes that mapped an earlier image at
+ * +path+ keep a consistent view of it.
+ */
+image_error_t image_write(const char *path, const trie_t *v4, const trie_t *v6, const dir24_t *dir24);
+
+/**
+ * Map the image at +path+ read-only and check it is consistent.
+ */
+image_error_t image_map(image_t *, const char *path);
+
+/**
+ * Unmap an image mapped by image_map.
+ */
+void image_unmap(image_t *);
+
+#endif                          /* __IMAGE_H__ */
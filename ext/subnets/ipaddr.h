@@ -19,8 +19,14 @@ typedef struct {
   ip4_t mask;
 } net4_t;
 
+/**
+ * An IPv6 address as two 64-bit words, most significant first, so
+ * masking and comparing take two word operations.  Hextet 0 is the
+ * top 16 bits of +hi+.
+ */
 typedef struct {
-  uint16_t x[8];
+  uint64_t hi;
+  uint64_t lo;
 } ip6_t;
 
 typedef struct {
@@ -29,21 +35,136 @@ typedef struct {
   ip6_t mask;
 } net6_t;
 
+/**
+ * Tagged union of any of the above.
+ */
+typedef enum {
+  ADDR_NONE = 0,
+  ADDR_IP4,
+  ADDR_IP6,
+  ADDR_NET4,
+  ADDR_NET6,
+} addr_type_t;
+
+typedef struct {
+  addr_type_t type;
+  union {
+    ip4_t ip4;
+    ip6_t ip6;
+    net4_t net4;
+    net6_t net6;
+  } u;
+} addr_t;
+
 /**
  * Make an IPv4 mask of the given prefixlen in the range [0,32].
  */
 ip4_t mk_mask4(int prefixlen);
 
+/**
+ * The IPv6 masks of every prefixlen in the range [0,128].
+ */
+extern const ip6_t ip6_masks[129];
+
 /**
  * Make an IPv6 mask of the given prefixlen in the range [0,128].
  */
-ip6_t mk_mask6(int prefixlen);
+static inline ip6_t
+mk_mask6(int prefixlen) {
+  return ip6_masks[prefixlen];
+}
+
+/**
+ * The 16-bit hextet +i+ of this ip in the range [0,8), most
+ * significant first.
+ */
+static inline uint16_t
+ip6_hextet(ip6_t ip, int i) {
+  return (i < 4 ? ip.hi : ip.lo) >> (48 - 16*(i & 3));
+}
+
+/**
+ * Make an ip from its eight hextets, most significant first.
+ */
+static inline ip6_t
+ip6_from_hextets(const uint16_t *x) {
+  ip6_t ip = { 0, 0 };
+  for (int i=0; i<4; i++) {
+    ip.hi = (ip.hi << 16) | x[i];
+    ip.lo = (ip.lo << 16) | x[i+4];
+  }
+  return ip;
+}
+
+static inline int
+ip6_eql_p(ip6_t a, ip6_t b) {
+  return ((a.hi ^ b.hi) | (a.lo ^ b.lo)) == 0;
+}
+
+/**
+ * Compare these addresses as unsigned 128-bit integers.
+ *
+ * @return -1, 0 or 1 as +a+ is less than, equal to or greater than +b+
+ */
+static inline int
+ip6_cmp(ip6_t a, ip6_t b) {
+  if (a.hi != b.hi) return a.hi < b.hi ? -1 : 1;
+  return (a.lo > b.lo) - (a.lo < b.lo);
+}
+
+static inline ip6_t
+ip6_not(ip6_t ip) {
+  ip6_t not = { ~ip.hi, ~ip.lo };
+  return not;
+}
+
+static inline ip6_t
+ip6_band(ip6_t a, ip6_t b) {
+  ip6_t band = { a.hi & b.hi, a.lo & b.lo };
+  return band;
+}
+
+static inline ip6_t
+ip6_bor(ip6_t a, ip6_t b) {
+  ip6_t bor = { a.hi | b.hi, a.lo | b.lo };
+  return bor;
+}
+
+static inline ip6_t
+ip6_xor(ip6_t a, ip6_t b) {
+  ip6_t xor = { a.hi ^ b.hi, a.lo ^ b.lo };
+  return xor;
+}
+
+/**
+ * Number of leading bits shared by these addresses.
+ */
+static inline int
+ip4_common_prefixlen(ip4_t a, ip4_t b) {
+  return a == b ? 32 : __builtin_clz(a ^ b);
+}
+
+static inline int
+ip6_common_prefixlen(ip6_t a, ip6_t b) {
+  uint64_t hi = a.hi ^ b.hi, lo = a.lo ^ b.lo;
+  if (hi) return __builtin_clzll(hi);
+  if (lo) return 64 + __builtin_clzll(lo);
+  return 128;
+}
 
 /**
  * Test if this network includes the given ip.
  */
-int net4_include_p(net4_t, ip4_t);
-int net6_include_p(net6_t, ip6_t);
+static inline int
+net4_include_p(net4_t net, ip4_t a) {
+  return ((net.address ^ a) & net.mask) == 0;
+}
+
+static inline int
+net6_include_p(net6_t net, ip6_t a) {
+  return (((net.address.hi ^ a.hi) & net.mask.hi) |
+          ((net.address.lo ^ a.lo) & net.mask.lo)) == 0;
+}
 
 /**
  * Test if this network includes the given network, which must have a
@@ -60,6 +181,28 @@ int net6_include_net6_p(net6_t, net6_t);
 net4_t net4_network(net4_t);
 net6_t net6_network(net6_t);
 
+/* longest string representations, excluding the NUL */
+#define IP4_FORMAT_MAX 15
+#define NET4_FORMAT_MAX 18
+#define IP6_FORMAT_MAX 39
+#define NET6_FORMAT_MAX 43
+
+/* bytes the formatters may write past the end of a representation */
+#define FORMAT_SLACK 3
+
+/**
+ * Write the string representation of this address or network to str,
+ * which must have room for the *_FORMAT_MAX chars plus FORMAT_SLACK:
+ * a decimal number is copied as four bytes, whatever its length.  No
+ * NUL is written.
+ *
+ * @return the length of the representation
+ */
+size_t ip4_format(ip4_t, char *);
+size_t ip6_format(ip6_t, char *);
+size_t net4_format(net4_t, char *);
+size_t net6_format(net6_t, char *);
+
 /**
  * Write a string representation of this network to the given string,
  * according to the rules of snprintf().
@@ -81,6 +224,17 @@ int ip6_snprint(ip6_t, char *, size_t);
 size_t read_ip4(const char *, ip4_t *);
 size_t read_ip6(const char *, ip6_t *);
 
+/**
+ * The portable implementation of read_ip4, used when the CPU lacks
+ * the instructions of the vectorized one.
+ */
+size_t read_ip4_scalar(const char *, ip4_t *);
+
+/**
+ * The portable implementation of read_ip6.
+ */
+size_t read_ip6_scalar(const char *, ip6_t *);
+
 /**
  * Read a network from the string, returning the number of bytes read,
  * or zero on parse error.
@@ -102,10 +256,38 @@ size_t read_ip6_strict(const char *, ip6_t *);
 size_t read_net4_strict(const char *, net4_t *);
 size_t read_net6_strict(const char *, net6_t *);
 
-int ip6_eql_p(ip6_t, ip6_t);
-ip6_t ip6_not(ip6_t);
-ip6_t ip6_band(ip6_t, ip6_t);
-ip6_t ip6_bor(ip6_t, ip6_t);
-ip6_t ip6_xor(ip6_t, ip6_t);
+/**
+ * Read whichever of an IPv4 or IPv6 address or network is at the
+ * start of the string into +addr+, returning the number of bytes
+ * read, or zero and ADDR_NONE on parse error.  An address followed by
+ * a slash but no valid prefixlen is read as just the address.
+ */
+size_t read_any(const char *, addr_t *);
+
+/**
+ * Like read_any, but it is an error if the address or network is not
+ * followed by a null byte.
+ */
+size_t read_any_strict(const char *, addr_t *);
+
+/**
+ * Like read_ip* and read_net*, but read at most +len+ bytes of the
+ * string, which need not be NUL-terminated.
+ */
+size_t read_ip4_n(const char *, size_t, ip4_t *);
+size_t read_ip6_n(const char *, size_t, ip6_t *);
+size_t read_net4_n(const char *, size_t, net4_t *);
+size_t read_net6_n(const char *, size_t, net6_t *);
+size_t read_any_n(const char *, size_t, addr_t *);
+
+/**
+ * Like read_*_n, but it is an error if the IP or network is not
+ * exactly +len+ bytes.
+ */
+size_t read_ip4_strict_n(const char *, size_t, ip4_t *);
+size_t read_ip6_strict_n(const char *, size_t, ip6_t *);
+size_t read_net4_strict_n(const char *, size_t, net4_t *);
+size_t read_net6_strict_n(const char *, size_t, net6_t *);
+size_t read_any_strict_n(const char *, size_t, addr_t *);
 
 #endif                          /* __IPADDR_H__ */
@@ -0,0 +1,199 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netlist.h"
+
+#if !defined(SUBNETS_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SUBNETS_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * A network with address a and mask m includes the network x/p when
+ * it is no longer, so m has no bits outside the mask of p, and x
+ * agrees with a on the bits of m; that is when
+ *
+ *   ((x ^ a) | ~mask(p)) & m == 0
+ *
+ * which is what every matcher below computes for each entry.
+ */
+
+static size_t
+round_block(size_t n) {
+  return (n + NETLIST_BLOCK - 1) / NETLIST_BLOCK * NETLIST_BLOCK;
+}
+
+int
+netlist_init(netlist_t *list, size_t n4, size_t n6) {
+  memset(list, 0, sizeof(*list));
+  list->cap4 = round_block(n4);
+  list->cap6 = round_block(n6);
+
+  if (list->cap4) {
+    list->addr4 = malloc(list->cap4 * sizeof(uint32_t));
+    list->mask4 = malloc(list->cap4 * sizeof(uint32_t));
+  }
+  if (list->cap6) {
+    list->addr6 = malloc(2 * list->cap6 * sizeof(uint64_t));
+    list->mask6 = malloc(2 * list->cap6 * sizeof(uint64_t));
+  }
+  if ((list->cap4 && !(list->addr4 && list->mask4)) ||
+      (list->cap6 && !(list->addr6 && list->mask6))) {
+    netlist_free(list);
+    return -1;
+  }
+  return 0;
+}
+
+void
+netlist_free(netlist_t *list) {
+  free(list->addr4);
+  free(list->mask4);
+  free(list->addr6);
+  free(list->mask6);
+  memset(list, 0, sizeof(*list));
+}
+
+size_t
+netlist_memsize(const netlist_t *list) {
+  return list->cap4 * 2 * sizeof(uint32_t) + list->cap6 * 4 * sizeof(uint64_t);
+}
+
+int
+netlist_add4(netlist_t *list, ip4_t address, int prefixlen) {
+  ip4_t mask = mk_mask4(prefixlen);
+  /* the first network also fills the padding */
+  size_t end = list->n4 ? list->n4 + 1 : list->cap4;
+
+  if (list->n4 == list->cap4) return -1;
+  for (size_t i = list->n4; i < end; i++) {
+    list->addr4[i] = address & mask;
+    list->mask4[i] = mask;
+  }
+  list->n4++;
+  return 0;
+}
+
+int
+netlist_add6(netlist_t *list, ip6_t address, int prefixlen) {
+  ip6_t mask = mk_mask6(prefixlen);
+  size_t end = list->n6 ? list->n6 + 1 : list->cap6;
+
+  if (list->n6 == list->cap6) return -1;
+  for (size_t i = list->n6; i < end; i++) {
+    list->addr6[i] = address.hi & mask.hi;
+    list->addr6[list->cap6 + i] = address.lo & mask.lo;
+    list->mask6[i] = mask.hi;
+    list->mask6[list->cap6 + i] = mask.lo;
+  }
+  list->n6++;
+  return 0;
+}
+
+static int
+match4_scalar(const netlist_t *list, ip4_t x, ip4_t notmask) {
+  int hit = 0;
+  for (size_t i = 0; i < list->n4; i++) {
+    hit |= (((x ^ list->addr4[i]) | notmask) & list->mask4[i]) == 0;
+  }
+  return hit;
+}
+
+static int
+match6_scalar(const netlist_t *list, ip6_t x, ip6_t notmask) {
+  const uint64_t *ahi = list->addr6, *alo = list->addr6 + list->cap6;
+  const uint64_t *mhi = list->mask6, *mlo = list->mask6 + list->cap6;
+  int hit = 0;
+
+  for (size_t i = 0; i < list->n6; i++) {
+    hit |= ((((x.hi ^ ahi[i]) | notmask.hi) & mhi[i]) |
+            (((x.lo ^ alo[i]) | notmask.lo) & mlo[i])) == 0;
+  }
+  return hit;
+}
+
+#ifdef SUBNETS_SIMD_X86
+__attribute__((target("avx2")))
+static int
+match4_avx2(const netlist_t *list, ip4_t x, ip4_t notmask) {
+  __m256i vx = _mm256_set1_epi32(x), vn = _mm256_set1_epi32(notmask);
+  __m256i zero = _mm256_setzero_si256();
+
+  for (size_t i = 0; i < list->cap4; i += 8) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) (list->addr4 + i));
+    __m256i m = _mm256_loadu_si256((const __m256i *) (list->mask4 + i));
+    __m256i t = _mm256_and_si256(_mm256_or_si256(_mm256_xor_si256(vx, a), vn), m);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(t, zero))) return 1;
+  }
+  return 0;
+}
+
+__attribute__((target("avx2")))
+static int
+match6_avx2(const netlist_t *list, ip6_t x, ip6_t notmask) {
+  const uint64_t *ahi = list->addr6, *alo = list->addr6 + list->cap6;
+  const uint64_t *mhi = list->mask6, *mlo = list->mask6 + list->cap6;
+  __m256i xhi = _mm256_set1_epi64x(x.hi), xlo = _mm256_set1_epi64x(x.lo);
+  __m256i nhi = _mm256_set1_epi64x(notmask.hi), nlo = _mm256_set1_epi64x(notmask.lo);
+  __m256i zero = _mm256_setzero_si256();
+
+  for (size_t i = 0; i < list->cap6; i += 4) {
+    __m256i hi = _mm256_xor_si256(xhi, _mm256_loadu_si256((const __m256i *) (ahi + i)));
+    __m256i lo = _mm256_xor_si256(xlo, _mm256_loadu_si256((const __m256i *) (alo + i)));
+    hi = _mm256_and_si256(_mm256_or_si256(hi, nhi), _mm256_loadu_si256((const __m256i *) (mhi + i)));
+    lo = _mm256_and_si256(_mm256_or_si256(lo, nlo), _mm256_loadu_si256((const __m256i *) (mlo + i)));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(_mm256_or_si256(hi, lo), zero))) return 1;
+  }
+  return 0;
+}
+
+__attribute__((target("sse2")))
+static int
+match4_sse2(const netlist_t *list, ip4_t x, ip4_t notmask) {
+  __m128i vx = _mm_set1_epi32(x), vn = _mm_set1_epi32(notmask);
+  __m128i zero = _mm_setzero_si128();
+
+  for (size_t i = 0; i < list->cap4; i += 8) {
+    __m128i t0 = _mm_xor_si128(vx, _mm_loadu_si128((const __m128i *) (list->addr4 + i)));
+    __m128i t1 = _mm_xor_si128(vx, _mm_loadu_si128((const __m128i *) (list->addr4 + i + 4)));
+    t0 = _mm_and_si128(_mm_or_si128(t0, vn), _mm_loadu_si128((const __m128i *) (list->mask4 + i)));
+    t1 = _mm_and_si128(_mm_or_si128(t1, vn), _mm_loadu_si128((const __m128i *) (list->mask4 + i + 4)));
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi32(t0, zero), _mm_cmpeq_epi32(t1, zero)))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int simd_avx2 = 0;
+static int simd_sse2 = 0;
+
+__attribute__((constructor))
+static void
+simd_init(void) {
+  __builtin_cpu_init();
+  simd_avx2 = __builtin_cpu_supports("avx2");
+  simd_sse2 = __builtin_cpu_supports("sse2");
+}
+#endif                          /* SUBNETS_SIMD_X86 */
+
+int
+netlist_match4(const netlist_t *list, ip4_t address, int prefixlen) {
+  ip4_t notmask = ~mk_mask4(prefixlen);
+#ifdef SUBNETS_SIMD_X86
+  if (simd_avx2) return match4_avx2(list, address, notmask);
+  if (simd_sse2) return match4_sse2(list, address, notmask);
+#endif
+  return match4_scalar(list, address, notmask);
+}
+
+int
+netlist_match6(const netlist_t *list, ip6_t address, int prefixlen) {
+  ip6_t notmask = ip6_not(mk_mask6(prefixlen));
+#ifdef SUBNETS_SIMD_X86
+  if (simd_avx2) return match6_avx2(list, address, notmask);
+#endif
+  return match6_scalar(list, address, notmask);
+}
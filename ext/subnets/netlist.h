@@ -0,0 +1,67 @@
+#ifndef __NETLIST_H__
+#define __NETLIST_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ipaddr.h"
+
+/* entries compared per step; lists are padded to a multiple of this */
+#define NETLIST_BLOCK 8
+
+/**
+ * A short list of networks laid out as a structure of arrays, with
+ * the addresses and masks of IPv4 networks in packed uint32 arrays
+ * and those of IPv6 networks as 64-bit halves.  An address is
+ * matched against a whole block of networks with a few vector
+ * compares and one test of the resulting mask, which beats walking a
+ * trie for lists of a few dozen networks.
+ *
+ * The slots after the last network of each family repeat its first
+ * network, so whole blocks are always compared.
+ */
+typedef struct {
+  uint32_t *addr4;
+  uint32_t *mask4;
+  size_t n4;
+  size_t cap4;                  /* n4 rounded up to NETLIST_BLOCK */
+  uint64_t *addr6;              /* hi halves, then lo halves */
+  uint64_t *mask6;
+  size_t n6;
+  size_t cap6;
+} netlist_t;
+
+/**
+ * Initialize an empty list with room for +n4+ IPv4 and +n6+ IPv6
+ * networks.
+ *
+ * @return zero on success, -1 if the arrays could not be allocated
+ */
+int netlist_init(netlist_t *, size_t n4, size_t n6);
+
+/**
+ * Release the arrays of this list.
+ */
+void netlist_free(netlist_t *);
+
+/**
+ * Number of bytes held by the arrays of this list.
+ */
+size_t netlist_memsize(const netlist_t *);
+
+/**
+ * Append a network.
+ *
+ * @return zero on success, -1 if the list is full
+ */
+int netlist_add4(netlist_t *, ip4_t address, int prefixlen);
+int netlist_add6(netlist_t *, ip6_t address, int prefixlen);
+
+/**
+ * Test if any network of this list includes the network +address+/
+ * +prefixlen+, which is a single address at the full prefixlen.
+ */
+int netlist_match4(const netlist_t *, ip4_t address, int prefixlen);
+int netlist_match6(const netlist_t *, ip6_t address, int prefixlen);
+
+#endif                          /* __NETLIST_H__ */
@@ -0,0 +1,82 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sort.h"
+
+/* digits 0-15 are the bytes of the key, most significant first */
+#define DIGIT_PREFIXLEN 16
+#define NDIGITS 17
+
+static unsigned
+item_digit(const sort_item_t *item, int d) {
+  if (d < 8) return (item->key.hi >> (56 - 8*d)) & 0xff;
+  if (d < 16) return (item->key.lo >> (56 - 8*(d - 8))) & 0xff;
+  return item->prefixlen;
+}
+
+/* scatter src into dst by digit d, with the digits of each word
+ * extracted by a constant shift so the loop stays branch free */
+static void
+scatter(const sort_item_t *src, sort_item_t *dst, size_t n, int d, size_t *offset) {
+  if (d == DIGIT_PREFIXLEN) {
+    for (size_t i = 0; i < n; i++) dst[offset[src[i].prefixlen & 0xff]++] = src[i];
+  } else if (d < 8) {
+    int shift = 56 - 8*d;
+    for (size_t i = 0; i < n; i++) dst[offset[(src[i].key.hi >> shift) & 0xff]++] = src[i];
+  } else {
+    int shift = 56 - 8*(d - 8);
+    for (size_t i = 0; i < n; i++) dst[offset[(src[i].key.lo >> shift) & 0xff]++] = src[i];
+  }
+}
+
+int
+radix_sort(sort_item_t *items, size_t n, int keybits, int prefixlens) {
+  int passes[NDIGITS], npasses = 0;
+  sort_item_t *src = items, *dst;
+  size_t (*counts)[256];
+
+  if (n < 2) return 0;
+
+  /* least significant digit first */
+  if (prefixlens) passes[npasses++] = DIGIT_PREFIXLEN;
+  for (int d = keybits / 8 - 1; d >= 0; d--) passes[npasses++] = d;
+
+  if (!(counts = calloc(NDIGITS, sizeof(*counts)))) return -1;
+  if (!(dst = malloc(n * sizeof(sort_item_t)))) {
+    free(counts);
+    return -1;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    for (int p = 0; p < npasses; p++) {
+      counts[passes[p]][item_digit(&items[i], passes[p])]++;
+    }
+  }
+
+  for (int p = 0; p < npasses; p++) {
+    size_t *count = counts[passes[p]], offset = 0;
+    sort_item_t *swap;
+
+    if (count[item_digit(&src[0], passes[p])] == n) continue;
+
+    for (int b = 0; b < 256; b++) {
+      size_t c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+    scatter(src, dst, n, passes[p], count);
+    swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != items) {
+    memcpy(items, src, n * sizeof(sort_item_t));
+    dst = src;
+  }
+  free(dst);
+  free(counts);
+  return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef __SORT_H__
+#define __SORT_H__
+
+#include <stddef.h>
+
+#include "trie.h"
+
+/**
+ * An address or network to sort, as a trie key and prefixlen, with
+ * its position in the input.
+ */
+typedef struct {
+  trie_key_t key;
+  size_t index;
+  int prefixlen;
+} sort_item_t;
+
+/**
+ * Sort +n+ items by key and then prefixlen with a stable LSD radix
+ * sort of 8-bit digits: one pass per byte of the first +keybits+ bits
+ * of the key (4 for IPv4, 16 for IPv6), preceded by one over the
+ * prefixlen if +prefixlens+.  The digits of every pass are counted
+ * up front, and passes over a digit shared by all items are skipped.
+ * Takes O(n) time and n items of scratch memory.
+ *
+ * @return zero on success, -1 if the scratch could not be allocated
+ */
+int radix_sort(sort_item_t *items, size_t n, int keybits, int prefixlens);
+
+#endif                          /* __SORT_H__ */
@@ -0,0 +1,316 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trie.h"
+
+static trie_key_t
+key_mask(trie_key_t key, int prefixlen) {
+  if (prefixlen <= 0) {
+    key.hi = 0;
+    key.lo = 0;
+  } else if (prefixlen < 64) {
+    key.hi &= ~((uint64_t) 0) << (64 - prefixlen);
+    key.lo = 0;
+  } else if (prefixlen == 64) {
+    key.lo = 0;
+  } else if (prefixlen < 128) {
+    key.lo &= ~((uint64_t) 0) << (128 - prefixlen);
+  }
+  return key;
+}
+
+static int
+key_bit(trie_key_t key, int i) {
+  if (i < 64) return (key.hi >> (63 - i)) & 1;
+  return (key.lo >> (127 - i)) & 1;
+}
+
+/* number of leading bits shared by a and b */
+static int
+key_common(trie_key_t a, trie_key_t b) {
+  uint64_t hi = a.hi ^ b.hi;
+  uint64_t lo = a.lo ^ b.lo;
+  if (hi) return __builtin_clzll(hi);
+  if (lo) return 64 + __builtin_clzll(lo);
+  return 128;
+}
+
+/* test if the first prefixlen bits of key equal those of node key */
+static int
+key_prefix_eq(trie_key_t key, trie_key_t prefix, int prefixlen) {
+  return key_common(key, prefix) >= prefixlen;
+}
+
+static uint32_t
+trie_node_new(trie_t *trie, trie_key_t key, int prefixlen, uint32_t value) {
+  trie_node_t *node;
+
+  if (trie->len == trie->cap) {
+    uint32_t cap = trie->cap * 2;
+    trie_node_t *nodes = realloc(trie->nodes, cap * sizeof(trie_node_t));
+    if (!nodes) return 0;
+    trie->nodes = nodes;
+    trie->cap = cap;
+  }
+
+  node = &trie->nodes[trie->len];
+  memset(node, 0, sizeof(*node));
+  node->key = key_mask(key, prefixlen);
+  node->prefixlen = prefixlen;
+  node->value = value;
+  if (value) trie->count++;
+
+  return trie->len++;
+}
+
+int
+trie_init(trie_t *trie, int maxlen) {
+  trie->cap = 16;
+  trie->len = 0;
+  trie->count = 0;
+  trie->maxlen = maxlen;
+  trie->jump = NULL;
+  trie->nodes = malloc(trie->cap * sizeof(trie_node_t));
+  if (!trie->nodes) return -1;
+
+  /* root /0 node, a member only once 0/0 is inserted */
+  memset(&trie->nodes[0], 0, sizeof(trie_node_t));
+  trie->len = 1;
+  return 0;
+}
+
+void
+trie_free(trie_t *trie) {
+  free(trie->nodes);
+  free(trie->jump);
+  trie->nodes = NULL;
+  trie->jump = NULL;
+  trie->len = trie->cap = trie->count = 0;
+}
+
+size_t
+trie_memsize(const trie_t *trie) {
+  return trie->cap * sizeof(trie_node_t) +
+    (trie->jump ? sizeof(trie_jump_t) << TRIE_JUMP_BITS : 0);
+}
+
+int
+trie_check(const trie_t *trie) {
+  uint32_t count = 0;
+
+  if (!trie->len || trie->nodes[0].prefixlen) return -1;
+
+  for (uint32_t i = 0; i < trie->len; i++) {
+    const trie_node_t *node = &trie->nodes[i];
+    if (node->prefixlen > trie->maxlen) return -1;
+    if (node->value) count++;
+    for (int b = 0; b < 2; b++) {
+      uint32_t c = node->child[b];
+      if (c >= trie->len) return -1;
+      if (c && trie->nodes[c].prefixlen <= node->prefixlen) return -1;
+    }
+  }
+  if (count != trie->count) return -1;
+
+  if (trie->jump) {
+    for (uint32_t j = 0; j < (1 << TRIE_JUMP_BITS); j++) {
+      if (trie->jump[j].node >= trie->len || trie->jump[j].best > trie->len) return -1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Recompute count jump table entries starting at first by walking
+ * down from the root through nodes of at most TRIE_JUMP_BITS bits.
+ */
+static void
+trie_jump_fill(trie_t *trie, uint32_t first, uint32_t count) {
+  for (uint32_t j = first; j < first + count; j++) {
+    trie_key_t key = { (uint64_t) j << (64 - TRIE_JUMP_BITS), 0 };
+    uint32_t idx = 0, best = 0;
+
+    for (;;) {
+      const trie_node_t *node = &trie->nodes[idx];
+      uint32_t c;
+
+      if (node->value) best = idx + 1;
+      if (node->prefixlen >= TRIE_JUMP_BITS) break;
+
+      c = node->child[key_bit(key, node->prefixlen)];
+      if (!c || trie->nodes[c].prefixlen > TRIE_JUMP_BITS) break;
+      if (!key_prefix_eq(key, trie->nodes[c].key, trie->nodes[c].prefixlen)) break;
+      idx = c;
+    }
+
+    trie->jump[j].node = idx;
+    trie->jump[j].best = best;
+  }
+}
+
+/*
+ * Bring the jump table up to date after an insert that created or
+ * changed nodes no shorter than prefixlen along the path to key.
+ */
+static void
+trie_jump_update(trie_t *trie, trie_key_t key, int prefixlen) {
+  if (!trie->jump) {
+    if (trie->len < TRIE_JUMP_MIN) return;
+    if (!(trie->jump = malloc(sizeof(trie_jump_t) << TRIE_JUMP_BITS))) return;
+    trie_jump_fill(trie, 0, 1 << TRIE_JUMP_BITS);
+  } else if (prefixlen <= TRIE_JUMP_BITS) {
+    trie_jump_fill(trie, key_mask(key, prefixlen).hi >> (64 - TRIE_JUMP_BITS),
+                   1 << (TRIE_JUMP_BITS - prefixlen));
+  }
+}
+
+/*
+ * Insert the prefix and set *changed to the shortest prefixlen of the
+ * nodes created or changed.
+ */
+static int
+trie_insert_node(trie_t *trie, trie_key_t key, int prefixlen, uint32_t value, int *changed) {
+  uint32_t idx = 0;
+
+  key = key_mask(key, prefixlen);
+  *changed = prefixlen;
+
+  for (;;) {
+    trie_node_t *node = &trie->nodes[idx];
+    uint32_t c, n;
+    int b, common;
+
+    /* invariant: node is a prefix of key no longer than prefixlen */
+    if (node->prefixlen == prefixlen) {
+      if (!node->value) trie->count++;
+      node->value = value;
+      return 0;
+    }
+
+    b = key_bit(key, node->prefixlen);
+    c = node->child[b];
+
+    if (!c) {
+      if (!(n = trie_node_new(trie, key, prefixlen, value))) return -1;
+      trie->nodes[idx].child[b] = n;
+      return 0;
+    }
+
+    common = key_common(key, trie->nodes[c].key);
+    if (common > prefixlen) common = prefixlen;
+
+    if (common >= trie->nodes[c].prefixlen) {
+      idx = c;
+      continue;
+    }
+
+    if (common == prefixlen) {
+      /* new prefix sits between node and child */
+      if (!(n = trie_node_new(trie, key, prefixlen, value))) return -1;
+      trie->nodes[n].child[key_bit(trie->nodes[c].key, prefixlen)] = c;
+    } else {
+      /* new branching node where key and child diverge */
+      uint32_t leaf;
+      *changed = common;
+      if (!(n = trie_node_new(trie, key, common, 0))) return -1;
+      if (!(leaf = trie_node_new(trie, key, prefixlen, value))) return -1;
+      trie->nodes[n].child[key_bit(key, common)] = leaf;
+      trie->nodes[n].child[key_bit(trie->nodes[c].key, common)] = c;
+    }
+    trie->nodes[idx].child[b] = n;
+    return 0;
+  }
+}
+
+int
+trie_insert(trie_t *trie, trie_key_t key, int prefixlen, uint32_t value) {
+  int changed;
+
+  if (trie_insert_node(trie, key, prefixlen, value, &changed)) return -1;
+  trie_jump_update(trie, key, changed);
+  return 0;
+}
+
+int
+trie_walk(const trie_t *trie, int (*fn)(const trie_node_t *, void *), void *arg) {
+  /* prefixlens grow down the trie, so it is at most 129 nodes deep */
+  uint32_t stack[2 * 129];
+  int top = 0, ret;
+
+  stack[top++] = 0;
+  while (top) {
+    const trie_node_t *node = &trie->nodes[stack[--top]];
+    if (node->value && (ret = fn(node, arg))) return ret;
+    if (node->child[1]) stack[top++] = node->child[1];
+    if (node->child[0]) stack[top++] = node->child[0];
+  }
+  return 0;
+}
+
+const trie_node_t *
+trie_match_any(const trie_t *trie, trie_key_t key, int prefixlen) {
+  uint32_t idx = 0;
+
+  if (trie->jump && prefixlen >= TRIE_JUMP_BITS) {
+    const trie_jump_t *jump = &trie->jump[key.hi >> (64 - TRIE_JUMP_BITS)];
+    if (jump->best) return &trie->nodes[jump->best - 1];
+    idx = jump->node;
+  }
+
+  for (;;) {
+    const trie_node_t *node = &trie->nodes[idx];
+
+    if (node->prefixlen > prefixlen) return NULL;
+    if (!key_prefix_eq(key, node->key, node->prefixlen)) return NULL;
+    if (node->value) return node;
+    if (node->prefixlen >= prefixlen) return NULL;
+
+    idx = node->child[key_bit(key, node->prefixlen)];
+    if (!idx) return NULL;
+  }
+}
+
+const trie_node_t *
+trie_match_longest(const trie_t *trie, trie_key_t key, int prefixlen) {
+  const trie_node_t *found = NULL;
+  uint32_t idx = 0;
+
+  if (trie->jump && prefixlen >= TRIE_JUMP_BITS) {
+    const trie_jump_t *jump = &trie->jump[key.hi >> (64 - TRIE_JUMP_BITS)];
+    if (jump->best) found = &trie->nodes[jump->best - 1];
+    idx = jump->node;
+  }
+
+  for (;;) {
+    const trie_node_t *node = &trie->nodes[idx];
+
+    if (node->prefixlen > prefixlen) return found;
+    if (!key_prefix_eq(key, node->key, node->prefixlen)) return found;
+    if (node->value) found = node;
+    if (node->prefixlen >= prefixlen) return found;
+
+    idx = node->child[key_bit(key, node->prefixlen)];
+    if (!idx) return found;
+  }
+}
+
+trie_node_t *
+trie_find(trie_t *trie, trie_key_t key, int prefixlen) {
+  uint32_t idx = 0;
+
+  key = key_mask(key, prefixlen);
+
+  for (;;) {
+    trie_node_t *node = &trie->nodes[idx];
+
+    if (node->prefixlen > prefixlen) return NULL;
+    if (!key_prefix_eq(key, node->key, node->prefixlen)) return NULL;
+    if (node->prefixlen == prefixlen) return node->value ? node : NULL;
+
+    idx = node->child[key_bit(key, node->prefixlen)];
+    if (!idx) return NULL;
+  }
+}
@@ -0,0 +1,145 @@
+#ifndef __TRIE_H__
+#define __TRIE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ipaddr.h"
+
+/**
+ * A key of up to 128 bits, most significant bit first.  IPv4
+ * addresses occupy the top 32 bits of +hi+.
+ */
+typedef struct {
+  uint64_t hi;
+  uint64_t lo;
+} trie_key_t;
+
+/**
+ * A node of a path-compressed binary trie.  Nodes live in a
+ * contiguous arena and refer to their children by index; index 0 is
+ * always the root, so a child index of 0 means "no child".
+ */
+typedef struct {
+  trie_key_t key;               /* prefix bits, host bits zeroed */
+  uint32_t child[2];
+  uint32_t value;               /* zero for pure branching nodes */
+  uint8_t prefixlen;
+  uint8_t pad[3];
+} trie_node_t;
+
+/**
+ * An entry of the jump table indexed by the first TRIE_JUMP_BITS bits
+ * of a key: the deepest node of at most that many bits on the path to
+ * the key, and 1 + the index of the deepest member node on that path
+ * (zero if none).
+ */
+typedef struct {
+  uint32_t node;
+  uint32_t best;
+} trie_jump_t;
+
+#define TRIE_JUMP_BITS 16
+
+/* number of nodes before a trie builds its jump table */
+#define TRIE_JUMP_MIN 4096
+
+typedef struct {
+  trie_node_t *nodes;
+  uint32_t len;
+  uint32_t cap;
+  uint32_t count;               /* nodes with a non-zero value */
+  int maxlen;                   /* 32 or 128 */
+  trie_jump_t *jump;            /* NULL until len reaches TRIE_JUMP_MIN */
+} trie_t;
+
+/**
+ * Initialize an empty trie holding keys of at most +maxlen+ bits.
+ *
+ * @return zero on success, -1 if the arena could not be allocated
+ */
+int trie_init(trie_t *, int maxlen);
+
+/**
+ * Release the arena of this trie.
+ */
+void trie_free(trie_t *);
+
+/**
+ * Insert the prefix +key+/+prefixlen+ with the given non-zero value,
+ * replacing the value of an existing identical prefix.
+ *
+ * @return zero on success, -1 if the arena could not be grown
+ */
+int trie_insert(trie_t *, trie_key_t key, int prefixlen, uint32_t value);
+
+/**
+ * Find any prefix of at most +prefixlen+ bits that includes +key+.
+ *
+ * @return the node of one such prefix, or NULL if none
+ */
+const trie_node_t *trie_match_any(const trie_t *, trie_key_t key, int prefixlen);
+
+/**
+ * Find the longest prefix of at most +prefixlen+ bits that includes
+ * +key+.
+ *
+ * @return the node of that prefix, or NULL if none
+ */
+const trie_node_t *trie_match_longest(const trie_t *, trie_key_t key, int prefixlen);
+
+/**
+ * Find the node holding exactly the prefix +key+/+prefixlen+.
+ *
+ * @return that node, or NULL if the prefix was never inserted
+ */
+trie_node_t *trie_find(trie_t *, trie_key_t key, int prefixlen);
+
+/**
+ * Call +fn+ with each node of this trie holding a value, in order of
+ * key and then prefixlen, so a prefix comes before the prefixes it
+ * includes.  Stops early when +fn+ returns non-zero.
+ *
+ * @return the last value returned by +fn+, or zero
+ */
+int trie_walk(const trie_t *, int (*fn)(const trie_node_t *, void *), void *arg);
+
+/**
+ * Number of bytes held by the arena and jump table of this trie.
+ */
+size_t trie_memsize(const trie_t *);
+
+/**
+ * Check that the child and jump table indices of this trie are in
+ * range, that prefixlens grow along every path, and that +count+ is
+ * the number of nodes holding a value, so lookups in a trie read from
+ * outside, such as a mapped image, stay in bounds and terminate.
+ *
+ * @return zero if so, -1 if not
+ */
+int trie_check(const trie_t *);
+
+static inline trie_key_t
+trie_key_from_ip4(ip4_t ip) {
+  trie_key_t key = { ((uint64_t) ip) << 32, 0 };
+  return key;
+}
+
+static inline trie_key_t
+trie_key_from_ip6(ip6_t ip) {
+  trie_key_t key = { ip.hi, ip.lo };
+  return key;
+}
+
+static inline ip4_t
+trie_key_to_ip4(trie_key_t key) {
+  return key.hi >> 32;
+}
+
+static inline ip6_t
+trie_key_to_ip6(trie_key_t key) {
+  ip6_t ip = { key.hi, key.lo };
+  return ip;
+}
+
+#endif                          /* __TRIE_H__ */
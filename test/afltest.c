@@ -1,5 +1,7 @@
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ipaddr.h"
 
@@ -17,25 +19,53 @@ main(int argc, char **argv) {
   buf[len] = '\0';
 
   {
-    net4_t net;
-    read_net4(buf, &net);
+    net4_t net, bounded;
+    size_t n = read_net4(buf, &net);
+    // the length-bounded reader must agree with the NUL-terminated one
+    if (n != read_net4_n(buf, len, &bounded) || (n && memcmp(&net, &bounded, sizeof(net)))) {
+      abort();
+    }
     read_net4_strict(buf, &net);
   }
   {
-    ip4_t ip;
-    read_ip4(buf, &ip);
+    ip4_t ip, scalar;
+    size_t n = read_ip4(buf, &ip);
+    // the vectorized reader must agree with the portable one
+    if (n != read_ip4_scalar(buf, &scalar) || (n && ip != scalar)) {
+      abort();
+    }
     //read_ip4_strict(buf, &ip);
   }
   {
-    net6_t net;
-    read_net6(buf, &net);
+    net6_t net, bounded;
+    size_t n = read_net6(buf, &net);
+    if (n != read_net6_n(buf, len, &bounded) || (n && memcmp(&net, &bounded, sizeof(net)))) {
+      abort();
+    }
     read_net6_strict(buf, &net);
   }
   {
-    ip6_t ip;
-    read_ip6(buf, &ip);
+    ip6_t ip, scalar;
+    size_t n = read_ip6(buf, &ip);
+    if (n != read_ip6_scalar(buf, &scalar) || (n && memcmp(&ip, &scalar, sizeof(ip)))) {
+      abort();
+    }
     //read_ip6_strict(buf, &ip);
   }
 
+  {
+    addr_t any, each;
+    size_t n = read_any_strict(buf, &any);
+    // read_any must classify as trying each strict reader in turn does
+    if (read_net4_strict(buf, &each.u.net4)) each.type = ADDR_NET4;
+    else if (read_net6_strict(buf, &each.u.net6)) each.type = ADDR_NET6;
+    else if (read_ip4_strict(buf, &each.u.ip4)) each.type = ADDR_IP4;
+    else if (read_ip6_strict(buf, &each.u.ip6)) each.type = ADDR_IP6;
+    else each.type = ADDR_NONE;
+    if (!n != (each.type == ADDR_NONE) || any.type != each.type) {
+      abort();
+    }
+  }
+
   return 0;
 }
@@ -0,0 +1,21 @@
+require 'benchmark'
+
+require 'subnets'
+
+# aggregate lists of random networks clustered in a /8, as vendor
+# feeds of adjacent and overlapping networks tend to be
+
+def measure(name, count)
+  result = nil
+  total = Benchmark.measure { result = yield }.real
+  puts "%-28.28s %7d nets: %9.2fms" % [name, count, total*1e3]
+  result
+end
+
+random = Random.new(1)
+
+[10_000, 100_000, 1_000_000].each do |count|
+  nets = (1..count).map { Subnets::Net4.new(0x0a000000 | random.rand(1 << 24), 24 + random.rand(9)) }
+  agg = measure('Subnets.aggregate', count) { Subnets.aggregate(nets) }
+  puts "%-28.28s %7d nets: %9d nets" % ['  aggregated to', count, agg.size]
+end
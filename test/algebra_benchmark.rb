@@ -0,0 +1,24 @@
+require 'benchmark'
+
+require 'subnets'
+
+# union, intersection and difference of two sets of random networks
+
+def measure(name, count)
+  result = nil
+  total = Benchmark.measure { result = yield }.real
+  puts "%-28.28s %7d nets: %9.2fms %8d nets" % [name, count, total*1e3, result.size]
+  result
+end
+
+random = Random.new(1)
+
+[10_000, 100_000, 1_000_000].each do |count|
+  a, b = 2.times.map do
+    Subnets::Set.new((1..count).map { Subnets::Net4.new(random.rand(1 << 32), 16 + random.rand(17)) })
+  end
+
+  measure('Subnets::Set#|', count) { a | b }
+  measure('Subnets::Set#&', count) { a & b }
+  measure('Subnets::Set#-', count) { a - b }
+end
@@ -0,0 +1,34 @@
+require 'benchmark'
+require 'objspace'
+
+require 'subnets'
+
+# allocate many short-lived IPs and nets and report time, GC runs and
+# GC time
+
+N = 1_000_000
+
+random = Random.new(1)
+samples = {
+  'IP4' => Subnets::IP4.random(random),
+  'IP6' => Subnets::IP6.random(random),
+  'Net4' => Subnets::Net4.random(random),
+  'Net6' => Subnets::Net6.random(random),
+}
+inputs = {
+  'IP4' => '192.168.1.10',
+  'IP6' => '2001:db8::1',
+  'Net4' => '192.168.0.0/16',
+  'Net6' => '2001:db8::/32',
+}
+
+samples.each do |name, obj|
+  input = inputs[name]
+  GC.start
+  gc = GC.stat.slice(:count, :time)
+  total = Benchmark.measure { N.times { Subnets.parse(input) } }.real
+
+  puts "%-5s %6.3fμs/new  %4d GCs %5dms  memsize_of %3d bytes" %
+       [name, total/N*1e6, GC.stat(:count) - gc[:count],
+        GC.stat(:time) - gc[:time], ObjectSpace.memsize_of(obj)]
+end
@@ -0,0 +1,34 @@
+require 'benchmark'
+
+require 'subnets'
+require 'well_known_subnets'
+
+# classify a batch of IP strings one call at a time, and with a
+# single include_many? call
+
+random = Random.new(1)
+nets = (PRIVATE_SUBNETS + CLOUDFRONT_SUBNETS).map(&Subnets.method(:parse))
+set = Subnets::Set.new(nets)
+ips = (1..200_000).map { Subnets::IP4.random(random).to_s }
+
+def measure(name, ips)
+  total = Benchmark.measure { yield }.real
+  puts "%-28.28s %6.3fμs/ip" % [name, total/ips.size*1e6]
+end
+
+measure('Subnets.include?', ips) { ips.map { |ip| Subnets.include?(nets, ip) } }
+measure('Subnets.include_many?', ips) { Subnets.include_many?(nets, ips) }
+measure('Subnets::Set#include?', ips) { ips.map { |ip| set.include?(ip) } }
+measure('Subnets::Set#include_many?', ips) { set.include_many?(ips) }
+
+# large batches release the GVL and fan out across Subnets.threads
+# native threads; count how far another Ruby thread gets meanwhile
+ips = ips * 10
+[1, Subnets.threads].uniq.each do |threads|
+  Subnets.threads = threads
+  ticks = 0
+  ticker = Thread.new { loop { ticks += 1; sleep 0.001 } }
+  measure("Set#include_many? #{threads} thread(s)", ips) { set.include_many?(ips) }
+  ticker.kill
+  puts "%-28.28s %6d ticks" % ['  other Ruby thread', ticks]
+end
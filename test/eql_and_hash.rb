@@ -40,4 +40,25 @@ module EqlAndHash
     assert_equal 'found', h[b]
     assert_nil h[new_obj_subclass]
   end
+
+  def test_compare
+    a, b = [new_obj, other_obj]
+    assert_equal 0, a <=> new_obj
+    assert_equal(-1, a <=> b)
+    assert_equal 1, b <=> a
+    assert_operator a, :<, b
+    assert_nil a <=> 'str'
+    assert_nil a <=> new_obj_subclass
+  end
+
+  def test_sort
+    random = Random.new
+    objs = (1..1000).map { klass.random(random) } + [other_obj, new_obj, new_obj]
+    key = proc { |o| o.is_a?(Subnets::Net) ? [o.address.to_i, o.prefixlen] : o.to_i }
+    sorted = Subnets.sort(objs)
+    assert_equal objs.each_with_index.sort_by { |o, i| [key.(o), i] }.map(&:first), sorted
+    assert_equal objs.sort, sorted
+    assert_equal [], Subnets.sort([])
+    assert_raises(ArgumentError) { Subnets.sort([new_obj, new_obj_subclass]) }
+  end
 end
@@ -0,0 +1,27 @@
+require 'benchmark'
+
+require 'subnets'
+
+# count occurrences of addresses and networks in a Hash, as per-client
+# counters do
+
+random = Random.new(1)
+keys = {
+  'IP4' => (1..10_000).map { Subnets::IP4.random(random) },
+  'IP6' => (1..10_000).map { Subnets::IP6.random(random) },
+  'Net4' => (1..10_000).map { Subnets::Net4.random(random) },
+  'Net6' => (1..10_000).map { Subnets::Net6.random(random) },
+}
+
+keys.each do |name, list|
+  # equal but distinct objects, so lookups go through hash and eql?
+  lookups = list.map { |k| Subnets.parse(k.to_s) } * 20
+  counts = Hash.new(0)
+
+  hash = Benchmark.measure { lookups.each(&:hash) }.real
+  insert = Benchmark.measure { list.each { |k| counts[k] += 1 } }.real
+  lookup = Benchmark.measure { lookups.each { |k| counts[k] += 1 } }.real
+
+  puts "%-5s hash %6.3fμs  insert %6.3fμs/key  lookup %6.3fμs/key" %
+       [name, hash/lookups.size*1e6, insert/list.size*1e6, lookup/lookups.size*1e6]
+end
@@ -0,0 +1,30 @@
+require 'benchmark'
+
+require 'subnets'
+require 'well_known_subnets'
+
+# test addresses held as Integers, by making an IP of each or directly
+
+def measure(name, ints)
+  hits = 0
+  GC.start
+  objects = GC.stat(:total_allocated_objects)
+  total = Benchmark.measure { ints.each { |i| hits += 1 if yield(i) } }.real
+  objects = GC.stat(:total_allocated_objects) - objects
+  puts "%-32.32s %6.1fns/ip %5.2f objects/ip (%2d%% hits)" %
+       [name, total/ints.size*1e9, objects.to_f/ints.size, 100*hits/ints.size]
+end
+
+random = Random.new(1)
+set = Subnets::Set.new(CLOUDFRONT_SUBNETS + PRIVATE_SUBNETS)
+net4 = Subnets.parse('10.0.0.0/8')
+net6 = Subnets.parse('fc00::/7')
+ints4 = (1..1_000_000).map { random.rand(1 << 32) }
+ints6 = (1..1_000_000).map { (0xfc00 + random.rand(4) << 112) | random.rand(1 << 112) }
+
+measure('Set#include?(IP4.new(i))', ints4) { |i| set.include?(Subnets::IP4.new(i)) }
+measure('Set#include_i?(i)', ints4) { |i| set.include_i?(i) }
+measure('Net4#include?(IP4.new(i))', ints4) { |i| net4.include?(Subnets::IP4.new(i)) }
+measure('Net4#include_i?(i)', ints4) { |i| net4.include_i?(i) }
+measure('Net6#include_i?(i)', ints6) { |i| net6.include_i?(i) }
+measure('Set#include_i?(i, 6)', ints6) { |i| set.include_i?(i, 6) }
@@ -0,0 +1,28 @@
+require 'benchmark'
+
+require 'subnets'
+
+# check random IPs against a large list of random networks, such as a
+# blocklist, comparing the linear Subnets.include? with Subnets::Set
+
+def measure(name, count, ips)
+  total = Benchmark.measure {
+    ips.each { |ip| yield ip }
+  }.total
+  puts "%-28.28s %6d nets: %9.2fμs/ip" % [name, count, total/ips.size*1e6]
+end
+
+random = Random.new(1)
+ips = (1..20000).map { Subnets::IP4.random(random).to_s }
+
+[100, 1_000, 10_000, 40_000].each do |count|
+  nets = (1..count).map { Subnets::Net4.new(random.rand(1 << 32), 16 + random.rand(17)) }
+  set = Subnets::Set.new(nets, engine: :trie)
+  dir24 = Subnets::Set.new(nets, engine: :dir24_8)
+
+  measure('Subnets.include?', count, ips) { |ip| Subnets.include?(nets, ip) }
+  measure('Subnets::Set#include?', count, ips) { |ip| set.include?(ip) }
+  measure('Subnets::Set#include? dir24', count, ips) { |ip| dir24.include?(ip) }
+  puts "%-28.28s %6d nets: %9.2fMB" % ['Subnets::Set#memsize', count, set.memsize/1e6]
+  puts "%-28.28s %6d nets: %9.2fMB" % ['Subnets::Set#memsize dir24', count, dir24.memsize/1e6]
+end
@@ -0,0 +1,70 @@
+require 'subnets'
+
+# reader threads look up random IPs in a Subnets::LiveSet while a
+# writer replaces, adds to and removes from it, reporting lookup
+# latency with and without updates.  Readers never wait on the writer,
+# but all threads share the GVL, so the worst latencies are those of
+# a reader waiting for its next time slice.
+
+DURATION = 2.0
+READERS = 4
+
+def percentile(sorted, p)
+  sorted[((sorted.size - 1) * p).round]
+end
+
+def run(live, ips, lists)
+  stop = false
+  updates = 0
+  writer = Thread.new do
+    until stop
+      if lists
+        list = lists[updates % lists.size]
+        case updates % 3
+        when 0 then live.replace(list)
+        when 1 then live.add(list.first(100))
+        else live.remove(list.last(100))
+        end
+        updates += 1
+      end
+      sleep 0.01
+    end
+  end
+
+  readers = (1..READERS).map do |n|
+    Thread.new do
+      latencies = []
+      i = n
+      until stop
+        ip = ips[i = (i + READERS) % ips.size]
+        t = Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+        live.include?(ip)
+        latencies << Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond) - t
+      end
+      latencies
+    end
+  end
+
+  sleep DURATION
+  stop = true
+  writer.join
+  latencies = readers.flat_map(&:value).sort
+
+  puts "%-16s %6d updates %9d lookups  p50 %6.2fμs  p99 %6.2fμs  p99.9 %8.2fμs  max %9.2fμs" %
+       [lists ? 'with updates' : 'without updates', updates, latencies.size,
+        percentile(latencies, 0.5) / 1e3, percentile(latencies, 0.99) / 1e3,
+        percentile(latencies, 0.999) / 1e3, latencies.last / 1e3]
+end
+
+random = Random.new(1)
+ips = (1..100_000).map { Subnets::IP4.random(random) }
+lists = (1..10).map do
+  (1..10_000).map { Subnets::Net4.new(random.rand(1 << 32), 16 + random.rand(17)) }
+end
+
+[:trie, :dir24_8].each do |engine|
+  puts engine
+  live = Subnets::LiveSet.new(lists.first, engine: engine)
+  run(live, ips, nil)
+  run(live, ips, lists)
+end
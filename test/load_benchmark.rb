@@ -0,0 +1,28 @@
+require 'benchmark'
+require 'tmpdir'
+
+require 'subnets'
+
+# build a set from a file of a million networks, one per line, by
+# reading and parsing each line in Ruby and with Subnets::Set.load
+
+def measure(name, count)
+  objects = GC.stat(:total_allocated_objects)
+  total = Benchmark.measure { yield }.real
+  objects = GC.stat(:total_allocated_objects) - objects
+  puts "%-32.32s %7d nets: %9.2fms %9d objects" % [name, count, total*1e3, objects]
+end
+
+random = Random.new(1)
+count = 1_000_000
+nets = (1..count).map { Subnets::Net4.new(random.rand(1 << 32), 16 + random.rand(17)) }
+
+Dir.mktmpdir do |dir|
+  path = File.join(dir, 'list.txt')
+  File.write(path, "# generated\n" + nets.map { |net| "#{net}\n" }.join)
+
+  measure('readlines and Subnets::Set.new', count) do
+    Subnets::Set.new(File.readlines(path, chomp: true).reject { |l| l.start_with?('#') })
+  end
+  measure('Subnets::Set.load', count) { Subnets::Set.load(path) }
+end
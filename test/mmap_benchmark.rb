@@ -0,0 +1,34 @@
+require 'benchmark'
+require 'tmpdir'
+
+require 'subnets'
+
+# load a large list of random networks by compiling it with
+# Subnets::Set.new and by mapping a dumped image with Subnets::Set.mmap
+
+def measure(name, count)
+  result = nil
+  total = Benchmark.measure { result = yield }.real
+  puts "%-28.28s %7d nets: %9.3fms" % [name, count, total*1e3]
+  result
+end
+
+random = Random.new(1)
+ips = (1..200_000).map { Subnets::IP4.random(random) }
+
+Dir.mktmpdir do |dir|
+  path = File.join(dir, 'set.img')
+
+  [10_000, 100_000, 1_000_000].each do |count|
+    nets = (1..count).map { Subnets::Net4.new(random.rand(1 << 32), 16 + random.rand(17)) }
+
+    [:trie, :dir24_8].each do |engine|
+      set = measure("Subnets::Set.new #{engine}", count) { Subnets::Set.new(nets, engine: engine) }
+      measure("Subnets::Set#dump #{engine}", count) { set.dump(path) }
+      mapped = measure("Subnets::Set.mmap #{engine}", count) { Subnets::Set.mmap(path) }
+
+      measure("include_many? #{engine}", count) { set.include_many?(ips) }
+      measure("include_many? mmap #{engine}", count) { mapped.include_many?(ips) }
+    end
+  end
+end
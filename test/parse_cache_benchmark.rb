@@ -0,0 +1,29 @@
+require 'benchmark'
+
+require 'subnets'
+require 'well_known_subnets'
+
+# look up strings drawn from a few thousand distinct addresses, as
+# repeat in X-Forwarded-For headers, with and without caching
+
+random = Random.new(1)
+nets = (PRIVATE_SUBNETS + CLOUDFRONT_SUBNETS).map(&Subnets.method(:parse))
+distinct = (1..2_000).map { Subnets::IP4.random(random).to_s } +
+           (1..500).map { Subnets::IP6.random(random).to_s }
+ips = (1..500_000).map { distinct.sample(random: random).dup }
+
+def measure(name, ips)
+  total = Benchmark.measure { yield }.real
+  puts "%-32.32s %6.3fμs/ip" % [name, total/ips.size*1e6]
+end
+
+[0, 4096].each do |size|
+  Subnets.parse_cache_size = size
+  set = Subnets::Set.new(nets, cache: size)
+
+  measure("Subnets.parse cache=#{size}", ips) { ips.each { |ip| Subnets.parse(ip) } }
+  measure("Subnets.include? cache=#{size}", ips) { ips.each { |ip| Subnets.include?(nets, ip) } }
+  measure("Subnets::Set#include? cache=#{size}", ips) { ips.each { |ip| set.include?(ip) } }
+
+  puts "  parse cache #{Subnets.parse_cache_stats}, set cache #{set.cache_stats}" if size > 0
+end
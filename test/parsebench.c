@@ -0,0 +1,122 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ipaddr.h"
+
+// compare read_ip4 and read_ip6 against their scalar versions, and
+// read_any_strict against trying each strict reader in turn, on
+// random addresses
+//
+// cc -O2 -o parsebench test/parsebench.c ext/subnets/ipaddr.c -Iext/subnets
+
+#define COUNT 1000000
+#define ROUNDS 20
+#define WIDTH 48
+
+typedef size_t (*reader_t)(const char *, void *);
+
+/* bytes of an addr_t holding the given type */
+#define ADDR_SIZE(type) (offsetof(addr_t, u) + sizeof(type))
+
+/* how strings were classified before read_any */
+static size_t
+read_each_strict(const char *s, addr_t *addr) {
+  size_t n;
+  if ((n = read_net4_strict(s, &addr->u.net4))) addr->type = ADDR_NET4;
+  else if ((n = read_net6_strict(s, &addr->u.net6))) addr->type = ADDR_NET6;
+  else if ((n = read_ip4_strict(s, &addr->u.ip4))) addr->type = ADDR_IP4;
+  else if ((n = read_ip6_strict(s, &addr->u.ip6))) addr->type = ADDR_IP6;
+  else addr->type = ADDR_NONE;
+  return n;
+}
+
+static double
+now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+run(reader_t reader, char (*bufs)[WIDTH], size_t *sum) {
+  addr_t ip;                    /* large enough for any */
+  double start = now();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < COUNT; i++) {
+      *sum += reader(bufs[i], &ip);
+    }
+  }
+  return now() - start;
+}
+
+static int
+bench(const char *name, reader_t fast, const char *slowname, reader_t scalar,
+      char (*bufs)[WIDTH], size_t size) {
+  size_t fsum = 0, ssum = 0;
+  double tfast, tscalar;
+
+  for (int i = 0; i < COUNT; i++) {
+    addr_t a, b;
+    size_t n;
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    n = fast(bufs[i], &a);
+    if (n != scalar(bufs[i], &b) || memcmp(&a, &b, size)) {
+      fprintf(stderr, "mismatch on %s\n", bufs[i]);
+      return 1;
+    }
+  }
+
+  tscalar = run(scalar, bufs, &ssum);
+  tfast = run(fast, bufs, &fsum);
+
+  printf("%-24s %6.1f M/s\n", slowname, COUNT * ROUNDS / tscalar / 1e6);
+  printf("%-24s %6.1f M/s\n", name, COUNT * ROUNDS / tfast / 1e6);
+  return fsum != ssum;
+}
+
+int
+main(void) {
+  char (*bufs)[WIDTH] = malloc(COUNT * sizeof(*bufs));
+  int err = 0;
+
+  srand(1);
+  for (int i = 0; i < COUNT; i++) {
+    snprintf(bufs[i], WIDTH, "%d.%d.%d.%d",
+             rand() % 256, rand() % 256, rand() % 256, rand() % 256);
+  }
+  err |= bench("read_ip4", (reader_t) read_ip4, "read_ip4_scalar", (reader_t) read_ip4_scalar,
+               bufs, sizeof(ip4_t));
+  err |= bench("read_any_strict ip4", (reader_t) read_any_strict, "read_each_strict ip4",
+               (reader_t) read_each_strict, bufs, ADDR_SIZE(ip4_t));
+
+  for (int i = 0; i < COUNT; i++) {
+    snprintf(bufs[i] + strlen(bufs[i]), WIDTH - strlen(bufs[i]), "/%d", rand() % 33);
+  }
+  err |= bench("read_any_strict net4", (reader_t) read_any_strict, "read_each_strict net4",
+               (reader_t) read_each_strict, bufs, ADDR_SIZE(net4_t));
+
+  for (int i = 0; i < COUNT; i++) {
+    uint16_t x[8];
+    for (int k = 0; k < 8; k++) {
+      x[k] = (rand() % 4 == 0) ? 0 : rand() & 0xffff;
+    }
+    ip6_snprint(ip6_from_hextets(x), bufs[i], WIDTH);
+  }
+  err |= bench("read_ip6", (reader_t) read_ip6, "read_ip6_scalar", (reader_t) read_ip6_scalar,
+               bufs, sizeof(ip6_t));
+  err |= bench("read_any_strict ip6", (reader_t) read_any_strict, "read_each_strict ip6",
+               (reader_t) read_each_strict, bufs, ADDR_SIZE(ip6_t));
+
+  for (int i = 0; i < COUNT; i++) {
+    snprintf(bufs[i] + strlen(bufs[i]), WIDTH - strlen(bufs[i]), "/%d", rand() % 129);
+  }
+  err |= bench("read_any_strict net6", (reader_t) read_any_strict, "read_each_strict net6",
+               (reader_t) read_each_strict, bufs, ADDR_SIZE(net6_t));
+
+  free(bufs);
+  return err;
+}
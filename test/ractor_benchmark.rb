@@ -0,0 +1,28 @@
+require 'benchmark'
+
+require 'subnets'
+
+# classify strings against one Subnets::Set shared by 1 to 8 Ractors,
+# each taking an equal share of the strings
+
+Warning[:experimental] = false
+
+random = Random.new(1)
+nets = (1..10_000).map { Subnets::Net4.new(random.rand(1 << 32), 16 + random.rand(17)) }
+set = Subnets::Set.new(nets)
+N = 2_000_000
+ips = Ractor.make_shareable((1..N).map { Subnets::IP4.random(random).to_s.freeze })
+
+[1, 2, 4, 8].each do |count|
+  total = Benchmark.measure do
+    ractors = (0...count).map do |i|
+      Ractor.new(set, ips, i, count) do |set, ips, i, count|
+        found = 0
+        (i...ips.size).step(count) { |j| found += 1 if set.include?(ips[j]) }
+        found
+      end
+    end
+    ractors.sum(&:take)
+  end.real
+  puts "%d ractors %9.2fM lookups/s" % [count, N / total / 1e6]
+end
@@ -120,3 +120,16 @@ inet6 = Patricia.new(:AF_INET6)
 
 getip = RPatricia.new(inet4, inet6)
 benchmark('rpatricia', getip, pub_cf_priv_priv)
+
+############################################################
+# Subnets.client_ip scanning the raw header in C
+
+headers = (1..10_000).map { pub_cf_priv_priv.call.join(', ') }
+set = Subnets::Set.new(proxies)
+
+total = Benchmark.measure { headers.each { |h| Subnets.client_ip(h, set) } }.total
+puts
+puts "checked %d headers at %.2fμs/req" % [headers.size, total/headers.size*1e6]
+plotbarslogscale(prefix: '%-15.15s %7.2fμs/req ',
+                 width: 36, min: 1, max: 2000, tics: [1,10,100,1000],
+                 data: { 'client_ip +CF' => total/headers.size*1e6 })
@@ -0,0 +1,35 @@
+require 'benchmark'
+
+require 'subnets'
+require 'well_known_subnets'
+
+# one address against short lists of networks, as an Array and as a Set
+
+def measure(name, ips)
+  hits = 0
+  total = Benchmark.measure { ips.each { |ip| hits += 1 if yield(ip) } }.real
+  puts "%-36.36s %6.1fns/ip (%2d%% hits)" % [name, total/ips.size*1e9, 100*hits/ips.size]
+end
+
+random = Random.new(1)
+
+{
+  'private' => PRIVATE_SUBNETS,
+  'private ipv4' => PRIVATE_SUBNETS_IPV4,
+  'cloudfront' => CLOUDFRONT_SUBNETS,
+}.each do |name, subnets|
+  nets = subnets.map(&Subnets.method(:parse)).freeze
+  set = Subnets::Set.new(nets)
+  ips = (1..1_000_000).map do
+    net = nets.sample(random: random)
+    net = Subnets.parse('0.0.0.0/0') if random.rand(2) == 0 || net.is_a?(Subnets::Net6)
+    Subnets::IP4.random(random) & ~net.mask | net.address
+  end
+
+  puts "#{name} (#{nets.size} nets)"
+  measure('  (block alone)', ips) { |ip| ip }
+  measure('  Subnets.include? (frozen)', ips) { |ip| Subnets.include?(nets, ip) }
+  unfrozen = nets.dup
+  measure('  Subnets.include? (not frozen)', ips) { |ip| Subnets.include?(unfrozen, ip) }
+  measure('  Subnets::Set#include?', ips) { |ip| set.include?(ip) }
+end
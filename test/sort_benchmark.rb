@@ -0,0 +1,25 @@
+require 'benchmark'
+
+require 'subnets'
+
+# sort a million addresses by Integer key, by <=> and by radix sort
+
+def measure(name, ips)
+  sorted = nil
+  GC.start
+  total = Benchmark.measure { sorted = yield(ips) }.real
+  puts "%-32.32s %6.1fns/ip" % [name, total/ips.size*1e9]
+  sorted
+end
+
+random = Random.new(1)
+ip4s = (1..1_000_000).map { Subnets::IP4.random(random) }
+ip6s = (1..1_000_000).map { Subnets::IP6.random(random) }
+
+[ip4s, ip6s].each do |ips|
+  name = ips.first.class.name.split('::').last
+  a = measure("#{name} sort_by(&:to_i)", ips) { |l| l.sort_by(&:to_i) }
+  b = measure("#{name} sort", ips) { |l| l.sort }
+  c = measure("Subnets.sort(#{name})", ips) { |l| Subnets.sort(l) }
+  raise 'sorts differ' unless a == b && b == c
+end
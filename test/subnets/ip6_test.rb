@@ -19,6 +19,11 @@ module Subnets
       [[5,5,5,5,5,5,5,5]]
     end
 
+    def test_parse_rejects_compression_after_eight_hextets
+      assert_raises(ParseError) { Subnets.parse('1:2:3:4:5:6:7:8::') }
+      assert_raises(ParseError) { Subnets.parse('1:2:3:4:5:6:7:8::1') }
+      refute Subnets::Set.new(['::/0']).include?('1:2:3:4:5:6:7:8::')
+    end
   end
 end
 
@@ -0,0 +1,71 @@
+require 'test_helper'
+
+module Subnets
+  class TestLiveSet < Minitest::Test
+    def setup
+      @live = LiveSet.new(%w(10.0.0.0/8 ::1), engine: :trie, cache: 16)
+    end
+
+    def test_new
+      assert_equal 0, LiveSet.new.size
+      assert_equal 2, @live.size
+      assert_equal :trie, @live.snapshot.engine
+      assert_equal 16, @live.snapshot.cache_stats[:size]
+      assert_raises(ParseError) { LiveSet.new(['10.0.0.0/33']) }
+    end
+
+    def test_include
+      assert_include @live, '10.1.2.3'
+      assert_include @live, '::1'
+      refute_include @live, '11.0.0.1'
+      assert_equal [true, false], @live.include_many?(%w(10.0.0.1 ::2))
+      assert(@live === '10.0.0.1')
+      assert @live.include_i?(0x0a010203)
+      assert @live.include_i?(1, 6)
+      refute @live.include_i?(0x0b000001)
+    end
+
+    def test_replace
+      set = Set.new(%w(192.168.0.0/16))
+      assert_same @live, @live.replace(%w(11.0.0.0/8))
+      assert_include @live, '11.0.0.1'
+      refute_include @live, '10.0.0.1'
+      assert_equal 16, @live.snapshot.cache_stats[:size]
+
+      @live.replace(set)
+      assert_same set, @live.snapshot
+    end
+
+    def test_add_and_remove
+      @live.add(%w(12.0.0.0/8 10.1.0.0/16))
+      assert_include @live, '12.0.0.1'
+      assert_equal 3, @live.size
+
+      @live.remove(%w(10.1.0.0/16 ::/0))
+      refute_include @live, '10.1.0.1'
+      assert_include @live, '10.2.0.1'
+      refute_include @live, '::1'
+      assert_raises(ParseError) { @live.add(['bad']) }
+      assert_include @live, '10.2.0.1'
+    end
+
+    def test_snapshot_is_unchanged_by_updates
+      snapshot = @live.snapshot
+      @live.replace([])
+      assert_include snapshot, '10.0.0.1'
+      refute_include @live, '10.0.0.1'
+    end
+
+    def test_concurrent_updates
+      threads = (0...8).map do |i|
+        Thread.new { 50.times { |j| @live.add(["172.16.#{i}.#{j}"]) } }
+      end
+      readers = (0...4).map do
+        Thread.new { 2000.times { assert_include @live, '10.0.0.1' } }
+      end
+      (threads + readers).each(&:join)
+      8.times { |i| 50.times { |j| assert_include @live, "172.16.#{i}.#{j}" } }
+      refute_include @live, '172.16.0.50'
+    end
+  end
+end
@@ -47,6 +47,12 @@ module Subnets
       end
     end
 
+    def test_to_s_longest
+      assert_equal '255.255.255.255/32', Net4.new(0xffffffff, 32).to_s
+      assert_equal '255.255.255.255/32', Net4.parse('255.255.255.255/32').to_s
+      assert_equal '255.255.255.255', IP4.new(0xffffffff).to_s
+    end
+
     def test_includes_ip
       net = Net4.parse '192.168.0.0/24'
       assert_include net, '192.168.0.0'
@@ -57,6 +63,17 @@ module Subnets
       refute_include net, Subnets.parse('10.168.0.2')
     end
 
+    def test_include_i?
+      net = Net4.parse '192.168.0.0/24'
+      assert net.include_i?(0xc0a80002)
+      refute net.include_i?(0xc0a80102)
+      refute net.include_i?(0)
+      assert_raises(RangeError) { net.include_i?(-1) }
+      assert_raises(RangeError) { net.include_i?(1 << 32) }
+      assert_raises(TypeError) { net.include_i?('192.168.0.2') }
+      assert_raises(TypeError) { Net4.parse('0.0.0.0/0').include_i?(1.5) }
+    end
+
     def test_includes_net
       net = Net4.parse '192.168.0.0/24'
       assert_include net, '192.168.0.0/24'
@@ -46,6 +46,7 @@ module Subnets
         { name: 'trailing single colon', s: '1::1:/1' },
         { name: 'leading zero in hextet', s: '045:1:2::/32' },
         { name: 'prefixlen too large', s: '1::/129' },
+        { name: 'compression after eight hextets', s: '1:2:3:4:5:6:7:8::/64' },
       ]
 
       data.each_with_index do |d, i|
@@ -68,6 +69,7 @@ module Subnets
         { name: 'embedded ipv4', s: '::1.2.3.4/96', to_s: '::102:304/96' },
         { name: 'embedded ipv4', s: 'fe:55::1.2.3.4/96', to_s: 'fe:55::102:304/96' },
         { name: 'embedded ipv4', s: 'a:b:c:d:e:f:1.2.3.4/128', to_s: 'a:b:c:d:e:f:102:304/128' },
+        { name: 'longest', s: 'ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff/128' },
       ]
 
       data.each_with_index do |d, i|
@@ -103,6 +105,13 @@ module Subnets
       end
     end
 
+    def test_mask
+      (0..128).each do |i|
+        mask = ((1 << i) - 1) << (128 - i)
+        assert_equal mask, Net6.parse("::/#{i}").mask.to_i
+      end
+    end
+
     class Include < Minitest::Test
       def setup
         @net = Net6.parse '1:2:3:4:5:6:7:8/96'
@@ -120,6 +129,16 @@ module Subnets
         end
       end
 
+      def test_include_i?
+        assert @net.include_i?(Subnets.parse('1:2:3:4:5:6:7:9').to_i)
+        refute @net.include_i?(Subnets.parse('5::').to_i)
+        refute @net.include_i?(0)
+        assert Net6.parse('::/96').include_i?(0xffffffff)
+        assert_raises(RangeError) { @net.include_i?(-1) }
+        assert_raises(RangeError) { @net.include_i?(1 << 128) }
+        assert_raises(TypeError) { Net6.parse('::/0').include_i?(2.5) }
+      end
+
       def test_returns_false_with_non_ips_or_nets
         ['a', /a/, 2].each do |obj|
           refute_include @net, obj
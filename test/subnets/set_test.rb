@@ -0,0 +1,411 @@
+require 'test_helper'
+require 'pathname'
+require 'stringio'
+require 'tmpdir'
+
+module Subnets
+  class TestSet < Minitest::Test
+    def engine
+      :trie
+    end
+
+    def setup
+      @set = Set.new(%w(
+        192.168.5.0/24
+        10.1.0.0/16
+        10.1.2.0/24
+        11:22::/16
+        1.2.3.4
+        ::1
+      ).map(&Subnets.method(:parse)), engine: engine)
+    end
+
+    def test_engine
+      assert_equal engine, @set.engine
+      assert_operator @set.memsize, :>, 0
+      assert_raises(ArgumentError) { Set.new([], engine: :other) }
+    end
+
+    def test_size
+      assert_equal 6, @set.size
+      assert_equal 0, Set.new([]).size
+      assert_equal 1, Set.new(['10.0.0.0/8', '10.0.0.0/8']).size
+    end
+
+    def test_new_parses_strings
+      set = Set.new(['10.0.0.0/8', '::1'])
+      assert_include set, '10.2.3.4'
+      assert_include set, '::1'
+      assert_raises(ParseError) { Set.new(['10.0.0.0/33']) }
+    end
+
+    def test_load
+      list = "# blocklist\n\n10.0.0.0/8 ; SBL1\r\n  1.2.3.4\t# a host\n::1#x\n;comment\n11:22::/16"
+      set = Set.load(StringIO.new(list), engine: engine)
+      assert_equal engine, set.engine
+      assert_equal 4, set.size
+      %w(10.2.3.4 1.2.3.4 ::1 11:22::33).each { |v| assert_include set, v }
+      refute_include set, '1.2.3.5'
+
+      Dir.mktmpdir do |dir|
+        path = File.join(dir, 'list.txt')
+        File.write(path, list)
+        assert_equal 4, Set.load(path).size
+        File.open(path) { |f| assert_equal 4, Set.load(f, cache: 4).size }
+        assert_equal 4, Set.load(Pathname.new(path)).size
+      end
+
+      # a reader that returns new Strings and ignores the buffer
+      reader = Object.new
+      chunks = ["10.0.0.0/8\n1.2.", "3.4\n", '']
+      reader.define_singleton_method(:read) { |n, buf = nil| chunks.shift }
+      assert_equal 2, Set.load(reader).size
+
+      reader.define_singleton_method(:read) { |n, buf = nil| 42 }
+      assert_raises(TypeError) { Set.load(reader) }
+
+      assert_equal 0, Set.load(StringIO.new('')).size
+      assert_raises(Errno::ENOENT) { Set.load('/nonexistent/list.txt') }
+    end
+
+    def test_load_reports_line_numbers
+      e = assert_raises(ParseError) { Set.load(StringIO.new("10.0.0.0/8\n# ok\n10.0.0.0/33\n")) }
+      assert_match(/line 3: .*10\.0\.0\.0\/33/, e.message)
+      e = assert_raises(ParseError) { Set.load(StringIO.new("::1\n" + 'x' * 1000)) }
+      assert_match(/line 2: /, e.message)
+      e = assert_raises(ParseError) { Set.load(StringIO.new("::1\n" + 'x' * 100_000)) }
+      assert_match(/line 2: /, e.message)
+    end
+
+    def test_load_across_chunks
+      random = Random.new
+      nets = (1..20_000).map { [Net4, Net6].sample(random: random).random(random) }
+      list = nets.map { |net| "#{net} # #{'-' * random.rand(300)}\n" }.join
+      set = Set.load(StringIO.new(list), engine: engine)
+      assert_equal Set.new(nets).size, set.size
+      nets.each { |net| assert_include set, net }
+    end
+
+    def test_load_long_lines_across_chunks
+      # a word after whitespace that runs past the first chunk
+      [65_525, 70_000].each do |pad|
+        set = Set.load(StringIO.new("1.2.3.5\n" + ' ' * pad + "1.2.3.4/24 #{'#' * 300}\n10.0.0.0/8"))
+        assert_equal 3, set.size
+        assert_include set, '1.2.3.200'
+        refute_include set, '64.0.0.0'
+      end
+
+      # a line starting just before the end of the first chunk
+      list = '#' * (65_536 - 261) + "\n" + ' ' * 247 + "1.2.3.4/24\n"
+      set = Set.load(StringIO.new(list))
+      assert_equal 1, set.size
+      assert_include set, '1.2.3.200'
+      refute_include set, '64.0.0.0'
+    end
+
+    def test_new_rejects_other_objects
+      assert_raises(TypeError) { Set.new([/a/]) }
+      assert_raises(TypeError) { Set.new('10.0.0.0/8') }
+    end
+
+    def test_includes_ip
+      assert_include @set, '192.168.5.4'
+      assert_include @set, IP4.new(0x0a010101)
+      assert_include @set, '11:22::33'
+      assert_include @set, '1.2.3.4'
+      assert_include @set, Subnets.parse('::1')
+
+      refute_include @set, '1.2.3.5'
+      refute_include @set, '::2'
+      refute_include @set, '33::'
+      refute_include @set, 'not an ip'
+      refute_include @set, 42
+    end
+
+    def test_include_i?
+      assert @set.include_i?(0x0a010101)
+      assert @set.include_i?(0x01020304, 4)
+      assert @set.include_i?(1, 6)
+      assert @set.include_i?(Subnets.parse('11:22::33').to_i, 6)
+      refute @set.include_i?(0x01020305)
+      refute @set.include_i?(2, 6)
+      refute @set.include_i?(0x0a010101, 6)
+      assert_raises(RangeError) { @set.include_i?(1 << 32) }
+      assert_raises(ArgumentError) { @set.include_i?(1, 5) }
+      assert_raises(TypeError) { @set.include_i?(0x0a010101 + 0.9) }
+      assert_raises(TypeError) { @set.include_i?(1.0, 6) }
+
+      ip6 = Subnets.parse('11:22::33').to_i
+      @set.include_i?(ip6, 6)
+      allocated = GC.stat(:total_allocated_objects)
+      100.times { @set.include_i?(0x0a010101) && @set.include_i?(ip6, 6) }
+      assert_operator GC.stat(:total_allocated_objects) - allocated, :<, 10
+    end
+
+    def test_includes_net
+      assert_include @set, '10.1.0.0/16'
+      assert_include @set, '10.1.2.128/25'
+      assert_include @set, Net6.parse('11:22:33::/48')
+
+      refute_include @set, '10.0.0.0/8'
+      refute_include @set, '11::/8'
+      refute_include @set, '::/0'
+    end
+
+    def test_includes_everything
+      set = Set.new(['0.0.0.0/0'], engine: engine)
+      assert_include set, '0.0.0.0'
+      assert_include set, '255.255.255.255/32'
+      refute_include set, '::'
+    end
+
+    def test_cache
+      assert_equal({ size: 0, hits: 0, misses: 0 }, @set.cache_stats)
+
+      set = Set.new(['10.0.0.0/8'], engine: engine, cache: 3)
+      assert_equal 4, set.cache_stats[:size]
+      2.times do
+        assert_include set, '10.1.2.3'
+        refute_include set, '11.1.2.3'
+        refute_include set, 'not an ip'
+        assert_include set, IP4.new(0x0a010101)
+      end
+      assert_equal({ size: 4, hits: 3, misses: 3 }, set.cache_stats)
+      assert_equal [true, false, false], set.include_many?(['10.1.2.3', '11.1.2.3', '12.0.0.1'])
+      assert_operator set.memsize, :>, Set.new(['10.0.0.0/8'], engine: engine).memsize
+      assert_raises(ArgumentError) { Set.new([], cache: -1) }
+    end
+
+    def test_include_many?
+      ips = ['192.168.5.4', '1.2.3.5', Subnets.parse('11:22::33'), 'not an ip', 42, '10.1.2.0/24']
+      assert_equal [true, false, true, false, false, true], @set.include_many?(ips)
+      assert_equal [], @set.include_many?([])
+    end
+
+    def test_include_many_without_gvl
+      random = Random.new
+      ips = (1..70_000).map do |i|
+        case i % 4
+        when 0 then IP4.random(random)
+        when 1 then IP4.random(random).to_s
+        when 2 then ['10.1.2.3', '11:22::1', '::2', 'x' * 100].sample(random: random)
+        else IP6.random(random).to_s
+        end
+      end
+      expected = ips.map { |ip| @set.include?(ip) }
+
+      threads, threshold = Subnets.threads, Subnets.thread_threshold
+      begin
+        Subnets.thread_threshold = 1
+        [1, 4].each do |n|
+          Subnets.threads = n
+          assert_equal expected, @set.include_many?(ips)
+          assert_equal expected.first(10), @set.include_many?(ips.first(10))
+        end
+      ensure
+        Subnets.threads = threads
+        Subnets.thread_threshold = threshold
+      end
+    end
+
+    def test_include_many_interrupted
+      random = Random.new
+      ips = (1..600_000).map { |i| i.even? ? IP4.random(random) : IP6.random(random).to_s }
+      expected = ips.map { |ip| @set.include?(ip) }
+
+      signals = 0
+      old = trap(:USR2) { signals += 1 }
+      threads = Subnets.threads
+      begin
+        Subnets.threads = 4
+        killer = Thread.new { loop { Process.kill(:USR2, Process.pid); sleep 0.0005 } }
+        assert_equal expected, @set.include_many?(ips)
+      ensure
+        killer&.kill&.join
+        trap(:USR2, old)
+        Subnets.threads = threads
+      end
+      assert_operator signals, :>, 0
+    end
+
+    def test_dump_and_mmap
+      Dir.mktmpdir do |dir|
+        path = File.join(dir, 'set.img')
+        assert_same @set, @set.dump(path)
+        assert_equal 0666 & ~File.umask, File.stat(path).mode & 0777
+        assert_equal [path], Dir[File.join(dir, '*')]
+
+        set = Set.mmap(path)
+        assert_equal engine, set.engine
+        assert_equal @set.size, set.size
+        %w(192.168.5.4 10.1.2.0/24 11:22::33 1.2.3.4 ::1).each { |v| assert_include set, v }
+        %w(1.2.3.5 10.0.0.0/8 ::2 33::).each { |v| refute_include set, v }
+        assert_equal [true, false], set.include_many?(['10.1.9.9', '::2'])
+        assert_equal 4, Set.mmap(path, cache: 4).cache_stats[:size]
+
+        # remapping an image written from a mapped set
+        set.dump(path)
+        assert_include Set.mmap(path), '11:22::33'
+
+        Set.new([], engine: engine).dump(path)
+        assert_equal 0, Set.mmap(path).size
+      end
+    end
+
+    def test_dump_and_mmap_large
+      random = Random.new
+      nets = (1..5000).map { [Net4, Net6].sample(random: random).random(random) }
+      set = Set.new(nets, engine: engine)
+      Dir.mktmpdir do |dir|
+        path = File.join(dir, 'set.img')
+        set.dump(path)
+        mapped = Set.mmap(path)
+        ips = (1..2000).map { [IP4, IP6].sample(random: random).random(random) } + nets
+        assert_equal set.include_many?(ips), mapped.include_many?(ips)
+      end
+    end
+
+    def test_mmap_rejects_bad_images
+      Dir.mktmpdir do |dir|
+        path = File.join(dir, 'set.img')
+        assert_raises(Errno::ENOENT) { Set.mmap(path) }
+
+        File.binwrite(path, 'not an image')
+        assert_raises(ImageError) { Set.mmap(path) }
+
+        @set.dump(path)
+        image = File.binread(path)
+
+        File.binwrite(path, image[0, image.size - 64])
+        assert_raises(ImageError) { Set.mmap(path) }
+
+        version = image.dup
+        version[8, 4] = [2].pack('V')
+        File.binwrite(path, version)
+        assert_raises(ImageError) { Set.mmap(path) }
+
+        # the root of the v4 trie pointing past the last node
+        child = image.dup
+        child[64 + 16, 4] = [0xffffffff].pack('V')
+        File.binwrite(path, child)
+        assert_raises(ImageError) { Set.mmap(path) }
+
+        # a v4 count higher than the number of v4 networks
+        count = image.dup
+        count[28, 4] = [image[28, 4].unpack1('V') + 7].pack('V')
+        File.binwrite(path, count)
+        assert_raises(ImageError) { Set.mmap(path) }
+      end
+    end
+
+    def test_algebra
+      other = Set.new(%w(10.0.0.0/8 1.2.3.0/24 ::/0))
+      union = @set | other
+      assert_instance_of Set, union
+      assert_equal engine, union.engine
+      assert_equal 4, union.size
+      assert_equal 4, (@set & other).size
+      assert_include @set & other, '11:22::33'
+      refute_include @set & other, '192.168.5.1'
+      assert_equal 1, (@set - other).size
+      assert_include @set - other, '192.168.5.1'
+      refute_include @set - other, '1.2.3.4'
+
+      assert_equal 0, (@set - @set).size
+      assert_equal 5, (@set | @set).size
+      assert_equal 0, (@set & Set.new([])).size
+      assert_raises(TypeError) { @set | [] }
+    end
+
+    def test_algebra_random
+      random = Random.new
+      start = Time.now
+      until Time.now - start > TIMED_TEST_DURATION
+        a, b = 2.times.map do
+          nets = (1..100).map do
+            if random.rand(2).zero?
+              Net4.new(0x0a000000 | random.rand(1 << 12), 20 + random.rand(13))
+            else
+              Net6.new([0x2001, 0xdb8, 0, 0, 0, 0, 0, random.rand(1 << 12)], 116 + random.rand(13))
+            end
+          end
+          Set.new(nets, engine: engine)
+        end
+        union, intersection, difference = a | b, a & b, a - b
+
+        ips = (0...(1 << 12)).flat_map do |i|
+          [IP4.new(0x0a000000 | i), IP6.new([0x2001, 0xdb8, 0, 0, 0, 0, 0, i])]
+        end
+        in_a, in_b = a.include_many?(ips), b.include_many?(ips)
+        assert_equal in_a.zip(in_b).map { |x, y| x || y }, union.include_many?(ips)
+        assert_equal in_a.zip(in_b).map { |x, y| x && y }, intersection.include_many?(ips)
+        assert_equal in_a.zip(in_b).map { |x, y| x && !y }, difference.include_many?(ips)
+
+        [union, intersection, difference].each do |set|
+          assert_equal set.size, (set | Set.new([])).size, 'not aggregated'
+        end
+      end
+    end
+
+    def test_shareable
+      assert @set.frozen?
+      assert Ractor.shareable?(@set)
+      assert Ractor.shareable?(@set | @set)
+
+      # lookups write to the cache
+      set = Set.new([], engine: engine, cache: 4)
+      assert set.frozen?
+      refute Ractor.shareable?(set)
+      assert_raises(Ractor::Error) { Ractor.make_shareable(set) }
+    end
+
+    def test_case_equality
+      case '10.1.9.9'
+      when @set then pass
+      else flunk
+      end
+    end
+
+    def test_random_against_include_p
+      random = Random.new
+      start = Time.now
+      until Time.now - start > TIMED_TEST_DURATION
+        # small sets are searched as a netlist, larger ones in the tries
+        nets = (1..random.rand(1..300)).map { [Net4, Net6].sample(random: random).random(random) }
+        set = Set.new(nets, engine: engine)
+        100.times do
+          klass = [Net4, Net6].sample(random: random)
+          net = nets.sample(random: random)
+          [net, net.address, klass.random(random), klass.random(random).address].each do |v|
+            assert_equal Subnets.include?(nets, v), set.include?(v), "#{nets} include #{v}"
+          end
+          ip = klass.random(random).address
+          assert_equal set.include?(ip), set.include_i?(ip.to_i, ip.is_a?(IP4) ? 4 : 6), "#{nets} include #{ip}"
+        end
+      end
+    end
+  end
+
+  class TestSetDir24 < TestSet
+    def engine
+      :dir24_8
+    end
+
+    def test_dir24_8_memsize
+      assert_operator @set.memsize, :>=, 64 << 20
+    end
+
+    def test_dir24_8_long_prefixes
+      set = Set.new(%w(10.0.0.0/8 10.1.1.0/25 10.1.1.128/32 10.1.1.129/32), engine: engine)
+      assert_include set, '10.1.1.1'
+      assert_include set, '10.1.1.1/8'
+      refute_include set, '10.1.1.1/7'
+
+      set = Set.new(%w(10.1.1.128/32 10.1.1.0/25), engine: engine)
+      assert_include set, '10.1.1.127'
+      assert_include set, '10.1.1.128'
+      refute_include set, '10.1.1.129'
+      refute_include set, '10.1.1.0/24'
+    end
+  end
+end
@@ -0,0 +1,99 @@
+require 'test_helper'
+
+module Subnets
+  class TestTable < Minitest::Test
+    def setup
+      @table = Table.new(
+        '10.0.0.0/8' => :ten,
+        '10.1.0.0/16' => :ten_one,
+        '10.1.2.3' => :host,
+        '11:22::/32' => :v6,
+        '::/0' => :default6,
+      )
+    end
+
+    def test_size
+      assert_equal 5, @table.size
+      assert_equal 0, Table.new.size
+    end
+
+    def test_longest_match
+      assert_equal :ten, @table['10.2.0.1']
+      assert_equal :ten_one, @table['10.1.0.1']
+      assert_equal :host, @table[IP4.new(0x0a010203)]
+      assert_equal :v6, @table['11:22::1']
+      assert_equal :default6, @table['11:23::1']
+      assert_nil @table['11.0.0.1']
+      assert_nil @table['not an ip']
+    end
+
+    def test_longest_match_net
+      assert_equal :ten_one, @table['10.1.128.0/17']
+      assert_equal :ten, @table[Net4.parse('10.1.0.0/15')]
+      assert_nil @table['10.0.0.0/7']
+      assert_equal :default6, @table['11:22::/31']
+    end
+
+    def test_match
+      assert_equal [Net4.parse('10.1.0.0/16'), :ten_one], @table.match('10.1.99.99')
+      assert_equal [Net6.parse('11:22::/32'), :v6], @table.match('11:22::1')
+      assert_nil @table.match('1.1.1.1')
+    end
+
+    def test_replace_value
+      @table['10.1.0.0/16'] = :replaced
+      assert_equal 5, @table.size
+      assert_equal :replaced, @table['10.1.5.5']
+    end
+
+    def test_store_rejects_bad_keys
+      assert_raises(ParseError) { @table['10.0.0.0/33'] = 1 }
+      assert_raises(TypeError) { @table[/a/] = 1 }
+      assert_raises(FrozenError) { @table.freeze['1.1.1.1'] = 1 }
+    end
+
+    def test_values_survive_gc
+      table = Table.new
+      1000.times { |i| table[Net4.new(i << 8, 24)] = "value #{i}" }
+      GC.start
+      assert_equal 'value 999', table[IP4.new(999 << 8)]
+    end
+
+    def test_large_table_against_linear_match
+      random = Random.new
+      nets = (1..5000).map { Net4.new(random.rand(1 << 32), random.rand(33)) }
+      table = Table.new
+      nets.each_with_index { |net, i| table[net] = i }
+      200.times do
+        ip = IP4.random(random)
+        best = nets.each_with_index.select { |n, _| n.include?(ip) }.
+                 max_by { |n, i| [n.prefixlen, i] }
+        assert_equal best && best[1], table[ip]
+      end
+    end
+
+    def test_random_against_linear_match
+      random = Random.new
+      start = Time.now
+      until Time.now - start > TIMED_TEST_DURATION
+        klass = [Net4, Net6].sample(random: random)
+        nets = (1..50).map { klass.random(random) }
+        table = Table.new
+        nets.each_with_index { |net, i| table[net] = i }
+        100.times do
+          net = nets.sample(random: random)
+          [net, net.address, klass.random(random).address].each do |v|
+            best = nets.each_with_index.select { |n, _| n.include?(v) }.
+                     max_by { |n, i| [n.prefixlen, i] }
+            if best
+              assert_equal best[0].prefixlen, table.match(v)[0].prefixlen
+              assert_equal best[1], table[v]
+            else
+              assert_nil table[v]
+            end
+          end
+        end
+      end
+    end
+  end
+end
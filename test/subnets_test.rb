@@ -12,6 +12,23 @@ class SubnetsTest < Minitest::Test
     assert_raises(Subnets::ParseError) { Subnets.parse(':1::') }
   end
 
+  def test_parse_substring
+    line = '203.0.113.9 - - [10/Oct/2000:13:55:36 -0700] "GET / HTTP/1.0" 200 from 2001:db8::/32'
+    assert_equal Subnets.parse('203.0.113.9'), Subnets.parse(line, 0, 11)
+    assert_equal Subnets.parse('2001:db8::/32'), Subnets.parse(line, line.index('2001'))
+    assert_equal Subnets.parse('2001:db8::/32'), Subnets::Net6.parse(line, line.index('2001'))
+    assert_equal Subnets.parse('3.0.113.9'), Subnets.parse(line, 2, 9)
+    assert_equal Subnets.parse('203.0.113.9/8'), Subnets::Net4.parse('x203.0.113.9/8x', 1, 13)
+    assert_raises(Subnets::ParseError) { Subnets.parse(line, 0, 12) }
+    assert_raises(Subnets::ParseError) { Subnets.parse(line, 0, 10) }
+    assert_raises(Subnets::ParseError) { Subnets::Net4.parse(line, 0, 11) }
+    assert_raises(Subnets::ParseError) { Subnets.parse(line, 0, 0) }
+    assert_raises(IndexError) { Subnets.parse(line, -1, 11) }
+    assert_raises(IndexError) { Subnets.parse(line, line.bytesize - 3, 4) }
+    assert_raises(IndexError) { Subnets.parse(line, 0, -1) }
+    assert_raises(Subnets::ParseError) { Subnets.parse("1.2.3.4\0") }
+  end
+
   def test_include?
     nets = %w(
       192.168.5.0/24
@@ -32,4 +49,226 @@ class SubnetsTest < Minitest::Test
     refute Subnets.include?(nets, '::1')
     refute Subnets.include?(nets, '33::')
   end
+
+  def test_include_frozen?
+    nets = %w(192.168.5.0/24 11:22::/16).map{|n| Subnets.parse(n)}
+    nets << /someregex/
+    nets.freeze
+
+    2.times do
+      assert Subnets.include?(nets, '192.168.5.4')
+      assert Subnets.include?(nets, Subnets.parse('11:22::/17'))
+      assert Subnets.include?(nets, 'someregex')
+      refute Subnets.include?(nets, '11::/8')
+      refute Subnets.include?(nets, '1.2.3.4')
+    end
+  end
+
+  # calls Subnets.include? with many other frozen lists from ===
+  class Reentrant
+    def initialize(lists)
+      @lists = lists
+    end
+
+    def ===(v)
+      @lists.each { |l| 2.times { Subnets.include?(l, v) } }
+      false
+    end
+  end
+
+  def test_include_frozen_reentrant
+    lists = (1..200).map { |i| [Subnets::Net4.new(i << 8, 24)].freeze }
+    nets = [Reentrant.new(lists), ->(v) { true }].freeze
+    5.times { assert Subnets.include?(nets, '1.2.3.4') }
+  end
+
+  def test_include_frozen_holds_no_arrays
+    weak = ObjectSpace::WeakMap.new
+    100.times do |i|
+      matcher = Reentrant.new([])
+      weak[i] = matcher
+      nets = [Subnets::Net4.new(i << 8, 24), matcher].freeze
+      2.times { Subnets.include?(nets, '1.2.3.4') }
+    end
+    3.times { GC.start(full_mark: true, immediate_sweep: true) }
+    other = [Subnets.parse('10.0.0.0/8')].freeze
+    2.times { Subnets.include?(other, '10.0.0.1') }
+    3.times { GC.start(full_mark: true, immediate_sweep: true) }
+    assert_operator weak.size, :<, 10
+  end
+
+  def test_include_frozen_random
+    random = Random.new
+    start = Time.now
+    until Time.now - start > TIMED_TEST_DURATION
+      lists = (1..20).map do
+        (1..random.rand(0..200)).map { [Subnets::Net4, Subnets::Net6].sample(random: random).random(random) }.freeze
+      end
+      100.times do
+        nets = lists.sample(random: random)
+        v = [Subnets::IP4, Subnets::IP6].sample(random: random).random(random)
+        v = nets.sample(random: random).address if !nets.empty? && random.rand(2).zero?
+        assert_equal Subnets.include?(nets.dup, v), Subnets.include?(nets, v), "#{nets} include #{v}"
+      end
+    end
+  end
+
+  def test_include_many?
+    nets = %w(
+      192.168.5.0/24
+      11:22::/16
+    ).map{|n| Subnets.parse(n)}
+    nets << /someregex/
+
+    ips = ['192.168.5.4', '1.2.3.4', Subnets.parse('11:22::33'), 'someregex', '192.168.5.0/25', '::1']
+    assert_equal [true, false, true, true, true, false], Subnets.include_many?(nets, ips)
+    assert_equal ips.map { |ip| Subnets.include?(nets, ip) }, Subnets.include_many?(nets, ips)
+    assert_equal [], Subnets.include_many?(nets, [])
+    assert_raises(TypeError) { Subnets.include_many?(nets, [1]) }
+  end
+
+  def test_sort
+    nets = %w(10.0.0.0/8 9.0.0.0/8 10.0.0.0/7 10.0.0.0/16 0.0.0.0/0).map { |n| Subnets.parse(n) }
+    assert_equal %w(0.0.0.0/0 9.0.0.0/8 10.0.0.0/7 10.0.0.0/8 10.0.0.0/16), Subnets.sort(nets).map(&:to_s)
+
+    ips = %w(::1 8000:: ::ffff:0:0 1:: ::).map { |ip| Subnets.parse(ip) }
+    assert_equal %w(:: ::1 ::ffff:0:0 1:: 8000::), Subnets.sort(ips).map(&:to_s)
+    assert_equal ips.sort, Subnets.sort(ips)
+
+    assert_raises(TypeError) { Subnets.sort(['10.0.0.1']) }
+    assert_raises(ArgumentError) { Subnets.sort([Subnets.parse('::1'), Subnets.parse('10.0.0.1')]) }
+  end
+
+  def test_aggregate
+    assert_equal [], Subnets.aggregate([])
+    assert_equal %w(10.0.0.0/24 ::1/128),
+                 Subnets.aggregate(%w(::1 10.0.0.128/25 10.0.0.7 10.0.0.0/25)).map(&:to_s)
+    assert_equal %w(10.0.0.0/22),
+                 Subnets.aggregate(%w(10.0.2.0/23 10.0.1.0/24 10.0.0.0/24 10.0.1.9)).map(&:to_s)
+    assert_equal %w(0.0.0.0/0 ::/0),
+                 Subnets.aggregate(%w(0.0.0.0/1 128.0.0.0/1 ::/1 8000::/1)).map(&:to_s)
+    assert_equal %w(10.0.0.0/8), Subnets.aggregate(%w(10.1.2.3/8)).map(&:to_s)
+    assert_equal %w(10.0.1.0/24 10.0.2.0/24), Subnets.aggregate(%w(10.0.2.0/24 10.0.1.0/24)).map(&:to_s)
+
+    assert_raises(Subnets::ParseError) { Subnets.aggregate(['10.0.0.0/33']) }
+    assert_raises(TypeError) { Subnets.aggregate([1]) }
+  end
+
+  def test_aggregate_random
+    random = Random.new
+    start = Time.now
+    until Time.now - start > TIMED_TEST_DURATION
+      # long prefixes of a small range, so that many merge
+      nets = (1..200).map do
+        if random.rand(2).zero?
+          Subnets::Net4.new(0x0a000000 | random.rand(1 << 12), 20 + random.rand(13))
+        else
+          Subnets::Net6.new([0x2001, 0xdb8, 0, 0, 0, 0, 0, random.rand(1 << 12)], 116 + random.rand(13))
+        end
+      end
+      agg = Subnets.aggregate(nets)
+
+      assert_equal agg, Subnets.aggregate(agg)
+      assert_equal agg, Subnets.aggregate(nets.shuffle(random: random))
+      assert_operator agg.size, :<=, nets.size
+
+      [Subnets::Net4, Subnets::Net6].each do |klass|
+        agg.grep(klass).each_cons(2) do |a, b|
+          refute a.include?(b.address), "#{a} and #{b} overlap"
+          refute_equal 1, Subnets.aggregate([a, b]).size, "#{a} and #{b} not merged"
+        end
+      end
+
+      set, aggset = Subnets::Set.new(nets), Subnets::Set.new(agg)
+      ips = (0...(1 << 12)).flat_map do |i|
+        [Subnets::IP4.new(0x0a000000 | i), Subnets::IP6.new([0x2001, 0xdb8, 0, 0, 0, 0, 0, i])]
+      end
+      assert_equal set.include_many?(ips), aggset.include_many?(ips), "#{nets} aggregated to #{agg}"
+    end
+  end
+
+  def test_ractor_shareable
+    %w(10.0.0.1 10.0.0.0/8 ::1 ::/64).each do |str|
+      addr = Subnets.parse(str)
+      assert addr.frozen?, "#{addr} not frozen"
+      assert Ractor.shareable?(addr), "#{addr} not shareable"
+    end
+    assert Ractor.shareable?(Subnets::IP4.random)
+    assert Ractor.shareable?(Subnets::Net6.new([0x2001, 0xdb8, 0, 0, 0, 0, 0, 0], 32))
+  end
+
+  def test_ractors
+    experimental, Warning[:experimental] = Warning[:experimental], false
+    set = Subnets::Set.new(%w(10.0.0.0/8 ::1))
+    ractors = (1..4).map do |i|
+      Ractor.new(set, i) do |set, i|
+        [set.include?("10.0.0.#{i}"), set.include_many?(%w(::1 ::2)), Subnets.parse("1.2.3.#{i}").to_s]
+      end
+    end
+    ractors.each.with_index(1) do |r, i|
+      assert_equal [true, [true, false], "1.2.3.#{i}"], r.take
+    end
+
+    r = Ractor.new { Subnets.threads = 1 }
+    e = assert_raises(Ractor::RemoteError) { r.take }
+    assert_instance_of Ractor::IsolationError, e.cause
+  ensure
+    Warning[:experimental] = experimental
+  end
+
+  def test_client_ip
+    nets = %w(10.0.0.0/8 fc00::/7).map { |n| Subnets.parse(n) }
+    set = Subnets::Set.new(nets)
+
+    [nets, set].each do |trusted|
+      assert_equal Subnets.parse('203.0.113.9'), Subnets.client_ip('203.0.113.9, 10.0.0.1', trusted)
+      assert_equal Subnets.parse('2.2.2.2'), Subnets.client_ip('1.1.1.1,2.2.2.2 , 10.1.1.1,fc00::1', trusted)
+      assert_equal Subnets.parse('10.0.0.1'), Subnets.client_ip('10.0.0.1, 10.0.0.2', trusted)
+      assert_equal Subnets.parse('10.0.0.3'), Subnets.client_ip('garbage, 10.0.0.3, unknown', trusted)
+      assert_equal Subnets.parse('1.2.3.4'), Subnets.client_ip('1.2.3.4:80', trusted)
+      assert_nil Subnets.client_ip('', trusted)
+      assert_nil Subnets.client_ip('10.0.0.0/8, _hidden', trusted)
+
+      assert_equal Subnets.parse('2001:db8:cafe::17'),
+                   Subnets.client_ip('for=192.0.2.60;proto=http;by=203.0.113.43, for="[2001:db8:cafe::17]:4711"', trusted)
+      assert_equal Subnets.parse('192.0.2.43'),
+                   Subnets.client_ip('for=198.51.100.17;by=x, proto=https; For="192.0.2.43:47011", for=10.0.0.1', trusted)
+      assert_equal Subnets.parse('fc00::1'), Subnets.client_ip('For="[fc00::1]:80", for=unknown, by=1.2.3.4', trusted)
+    end
+
+    assert_equal Subnets.parse('1.2.3.4'),
+                 Subnets.client_ip('1.2.3.4, 5.6.7.8', [/x/, ->(ip) { ip.to_s == '5.6.7.8' }])
+    assert_raises(TypeError) { Subnets.client_ip('1.2.3.4', nil) }
+  end
+
+  def test_parse_cache
+    Subnets.parse_cache_size = 8
+    assert_equal 8, Subnets.parse_cache_size
+    assert_equal({ size: 8, hits: 0, misses: 0 }, Subnets.parse_cache_stats)
+
+    2.times do
+      assert_equal Subnets::Net4.parse('10.0.0.0/8'), Subnets.parse('10.0.0.0/8')
+      assert_equal Subnets::IP6.new([1, 0, 0, 0, 0, 0, 0, 1]), Subnets.parse('1::1')
+      assert Subnets.include?([Subnets.parse('10.0.0.0/8')], '10.1.2.3')
+      assert_raises(Subnets::ParseError) { Subnets.parse('10.0.0.0/33') }
+      assert_raises(Subnets::ParseError) { Subnets.parse("1.2.3.4\0") }
+    end
+
+    stats = Subnets.parse_cache_stats
+    assert_equal 7, stats[:hits]
+    assert_equal 5, stats[:misses]
+
+    (1..100).each { |i| assert_equal "10.0.0.#{i}", Subnets.parse("10.0.0.#{i}").to_s }
+    assert_raises(ArgumentError) { Subnets.parse_cache_size = -1 }
+  ensure
+    Subnets.parse_cache_size = 0
+    assert_equal({ size: 0, hits: 0, misses: 0 }, Subnets.parse_cache_stats)
+  end
+
+  def test_threads
+    assert_operator Subnets.threads, :>=, 1
+    assert_operator Subnets.thread_threshold, :>=, 1
+    assert_raises(ArgumentError) { Subnets.threads = 0 }
+    assert_raises(ArgumentError) { Subnets.thread_threshold = 0 }
+  end
 end
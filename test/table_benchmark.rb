@@ -0,0 +1,20 @@
+require 'benchmark'
+
+require 'subnets'
+
+# longest-prefix match of random IPs against a table of random routes
+
+random = Random.new(1)
+ips = (1..100_000).map { Subnets::IP4.random(random) }
+
+[1_000, 100_000, 1_000_000].each do |count|
+  table = Subnets::Table.new
+  build = Benchmark.measure {
+    count.times do |i|
+      table[Subnets::Net4.new(random.rand(1 << 32), 8 + random.rand(25))] = i
+    end
+  }.total
+
+  total = Benchmark.measure { ips.each { |ip| table[ip] } }.total
+  puts "%8d routes: built in %5.2fs, %5.2fμs/lookup" % [count, build, total/ips.size*1e6]
+end
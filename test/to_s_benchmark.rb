@@ -0,0 +1,19 @@
+require 'benchmark'
+
+require 'subnets'
+
+# format addresses and networks as strings, as when logging every
+# request
+
+random = Random.new(1)
+objs = {
+  'IP4#to_s' => (1..200_000).map { Subnets::IP4.random(random) },
+  'IP6#to_s' => (1..200_000).map { Subnets::IP6.random(random) },
+  'Net4#to_s' => (1..200_000).map { Subnets::Net4.random(random) },
+  'Net6#to_s' => (1..200_000).map { Subnets::Net6.random(random) },
+}
+
+objs.each do |name, list|
+  total = Benchmark.measure { list.each(&:to_s) }.real
+  puts "%-12s %6.3fμs/call" % [name, total/list.size*1e6]
+end